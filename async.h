@@ -0,0 +1,152 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+#include "serializer.h"
+
+// Asynchronous operations as a task graph of shared futures: every call starts its work immediately and
+// returns a task, tasks passed as inputs become dependencies that are awaited by the worker, not the caller.
+namespace matrices::async {
+    template<typename T>
+    using task = std::shared_future<T>;
+
+    // Runs function(inputs.get()...) once all inputs are ready.
+    template<typename Function, typename... Inputs>
+    [[nodiscard]] auto then(Function&& function, task<Inputs>... inputs) -> task<std::invoke_result_t<Function&, const Inputs&...>> {
+        return std::async(std::launch::async, [function = std::forward<Function>(function), ... inputs = std::move(inputs)]() mutable {
+            return std::invoke(function, inputs.get()...);
+        }).share();
+    }
+
+    [[nodiscard]] inline task<matrix_d<double>> load_csv(const std::filesystem::path& path) {
+        return std::async(std::launch::async, [path]() {
+            return serialize::from_csv(path);
+        }).share();
+    }
+
+    template<typename Matrix>
+    [[nodiscard]] task<void> write_csv(const std::filesystem::path& path, task<Matrix> matrix, const char delim = ',') {
+        return std::async(std::launch::async, [path, matrix = std::move(matrix), delim]() {
+            serialize::to_csv(path, matrix.get(), delim);
+        }).share();
+    }
+
+    [[nodiscard]] inline task<matrix_d<double>> multiply(task<matrix_d<double>> left, task<matrix_d<double>> right) {
+        return then([](const matrix_d<double>& first, const matrix_d<double>& second) {
+            return first * second;
+        }, std::move(left), std::move(right));
+    }
+
+    // Multiplies the operands in blocks of `block_rows` rows and writes every finished block to the CSV file
+    // while the following blocks are still being computed. Rows go to a temporary file next to `path` that
+    // replaces it only once the whole product has been written, a failure leaves the previous file untouched.
+    [[nodiscard]] inline task<void> multiply_to_csv(const std::filesystem::path& path, task<matrix_d<double>> left, task<matrix_d<double>> right,
+        std::uint32_t block_rows = 64, const char delim = ',') {
+        return std::async(std::launch::async, [path, left = std::move(left), right = std::move(right), block_rows, delim]() {
+            const auto& first = left.get();
+            const auto& second = right.get();
+
+            if (first.get_columns_count() != second.get_rows_count()) {
+                throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
+            }
+
+            auto staging = path;
+            staging += ".partial";
+
+            std::ofstream file(staging);
+            if (!file.is_open()) {
+                throw std::runtime_error("Unable to open file for writting");
+            }
+
+            auto discard = [&]() {
+                file.close();
+                std::error_code ignored;
+                std::filesystem::remove(staging, ignored);
+            };
+
+            const auto rows = first.get_rows_count();
+            const auto block = std::max<std::uint32_t>(block_rows, 1);
+            matrix_d<double> result(rows, second.get_columns_count());
+
+            std::mutex mutex;
+            std::condition_variable ready;
+            std::uint32_t computed_rows{ 0 };
+            bool failed{ false };
+
+            auto writer = std::async(std::launch::async, [&]() {
+                for (std::uint32_t written = 0; written < rows;) {
+                    std::unique_lock lock(mutex);
+                    ready.wait(lock, [&]() { return computed_rows > written || failed; });
+                    if (failed) {
+                        return;
+                    }
+
+                    auto available = computed_rows;
+                    lock.unlock();
+
+                    MATRICES_PROFILE_SCOPE("write", "phase");
+                    serialize::write_csv_rows(file, std::as_const(result), written, available, delim);
+                    written = available;
+                }
+            });
+
+            try {
+                MATRICES_PROFILE_SCOPE("compute", "phase");
+                for (std::uint32_t row = 0; row < rows; row += block) {
+                    auto last = std::min(row + block, rows);
+                    first.multiply_rows_into(second, row, last, result);
+                    {
+                        std::lock_guard lock(mutex);
+                        computed_rows = last;
+                    }
+                    ready.notify_one();
+                }
+            }
+            catch (...) {
+                {
+                    std::lock_guard lock(mutex);
+                    failed = true;
+                }
+                ready.notify_one();
+                writer.wait();
+                discard();
+                throw;
+            }
+
+            try {
+                writer.get();
+            }
+            catch (...) {
+                discard();
+                throw;
+            }
+
+            file.close();
+            if (!file) {
+                discard();
+                throw std::runtime_error("Unable to write the result matrix");
+            }
+            std::filesystem::rename(staging, path);
+            std::cout << std::format("Exported to {}\n", path.string());
+        }).share();
+    }
+}
@@ -0,0 +1,238 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "matrices.h"
+#include "tuning.h"
+
+// Micro-benchmarks of the tuning knobs on the current machine. Every knob is searched on its own, in the order
+// of the fields, with the already chosen values in effect: tile sizes and crossovers by timing the candidates,
+// parallel thresholds as the smallest size from which the threaded kernel beats the single threaded one.
+namespace matrices::tuning {
+    namespace detail {
+        // best of `repeat` runs after a warm up run, in milliseconds
+        inline double best_time(std::uint32_t repeat, const std::function<void()>& run) {
+            run();
+
+            auto best = std::numeric_limits<double>::max();
+            for (std::uint32_t index = 0; index < repeat; ++index) {
+                auto start = std::chrono::steady_clock::now();
+                run();
+                std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count());
+            }
+            return best;
+        }
+
+        inline matrix_d<double> random_matrix(std::uint32_t size, std::uint32_t seed) {
+            std::mt19937_64 engine(seed);
+            std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+            std::vector<double> values(static_cast<std::size_t>(size) * size);
+            for (auto& value : values) {
+                value = distribution(engine);
+            }
+            // diagonally dominant, so the factorizations are well defined
+            for (std::uint32_t index = 0; index < size; ++index) {
+                values[static_cast<std::size_t>(index) * size + index] += size;
+            }
+            return matrix_d<double>(size, size, std::move(values));
+        }
+
+        inline void search(std::ostream& log, const char* name, std::size_t parameters::* knob, const std::vector<std::size_t>& candidates,
+            std::uint32_t repeat, const std::function<void()>& run) {
+            auto& tuned = current();
+            auto best = tuned.*knob;
+            auto best_time_ms = std::numeric_limits<double>::max();
+
+            log << name << ":";
+            for (auto candidate : candidates) {
+                tuned.*knob = candidate;
+                auto time = best_time(repeat, run);
+                log << std::format(" {} ({:.3f} ms)", candidate, time);
+                if (time < best_time_ms) {
+                    best_time_ms = time;
+                    best = candidate;
+                }
+            }
+
+            tuned.*knob = best;
+            log << std::format(" -> {}\n", best);
+        }
+
+        // `sizes` are in the unit of the knob, run(size) times the kernel on a problem of that size
+        inline void crossover(std::ostream& log, const char* name, std::size_t parameters::* knob, const std::vector<std::size_t>& sizes,
+            std::uint32_t repeat, const std::function<void(std::size_t)>& run) {
+            auto& tuned = current();
+
+            log << name << ":";
+            for (auto size : sizes) {
+                tuned.*knob = std::numeric_limits<std::size_t>::max();
+                auto serial = best_time(repeat, [&]() { run(size); });
+                tuned.*knob = 0;
+                auto parallel = best_time(repeat, [&]() { run(size); });
+
+                log << std::format(" {} ({:.3f} / {:.3f} ms)", size, serial, parallel);
+                // a clear win only, the threads cost more on a loaded machine
+                if (parallel < serial * 0.9) {
+                    tuned.*knob = size;
+                    log << std::format(" -> {}\n", size);
+                    return;
+                }
+            }
+
+            tuned.*knob = sizes.back() * 2;
+            log << std::format(" -> {}\n", tuned.*knob);
+        }
+
+        template<std::uint32_t Size>
+        void fixed_multiply() {
+            static const auto operand = std::make_unique<matrix_f<double, Size, Size>>();
+            volatile double sink = operand->multiply_with_threads(*operand)(0, 0);
+            (void)sink;
+        }
+    }
+
+    // Tunes current() in place and returns the result. `quick` halves the problem sizes.
+    inline parameters autotune(std::ostream& log, bool quick = false) {
+        using detail::search;
+        using detail::crossover;
+
+        auto& tuned = current();
+        const std::uint32_t repeat = quick ? 2 : 3;
+        const std::uint32_t gemm_size = quick ? 256 : 512;
+        volatile double sink{ 0.0 };
+
+        // square inputs of the crossover searches, generated outside of the timed runs
+        std::map<std::uint32_t, matrix_d<double>> inputs;
+        auto input = [&](double size) -> const matrix_d<double>& {
+            auto n = std::max<std::uint32_t>(static_cast<std::uint32_t>(std::lround(size)), 1);
+            if (!inputs.contains(n)) {
+                inputs.emplace(n, detail::random_matrix(n, n));
+            }
+            return inputs.at(n);
+        };
+
+        auto left = detail::random_matrix(gemm_size, 1);
+        auto right = detail::random_matrix(gemm_size, 2);
+        auto multiply = [&]() { sink = (left * right)(0, 0); };
+
+        const std::size_t hardware = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+        std::vector<std::size_t> thread_counts;
+        for (std::size_t count = 1; count < hardware; count *= 2) {
+            thread_counts.push_back(count);
+        }
+        thread_counts.push_back(hardware);
+
+        if (thread_counts.size() > 1) {
+            search(log, "threads", &parameters::threads, thread_counts, repeat, multiply);
+            if (tuned.threads == hardware) {
+                tuned.threads = 0;
+            }
+        }
+        else {
+            tuned.threads = 0;
+            log << "threads: a single hardware thread\n";
+        }
+        const bool parallel = thread_counts.size() > 1 && tuned.threads != 1;
+
+        search(log, "gemm_depth_block", &parameters::gemm_depth_block, { 64, 128, 256, 512 }, repeat, multiply);
+        if (parallel) {
+            search(log, "gemm_row_grain", &parameters::gemm_row_grain, { 4, 8, 16, 32, 64 }, repeat, multiply);
+        }
+
+        const std::uint32_t strassen_size = quick ? 512 : 1024;
+        {
+            auto strassen_left = detail::random_matrix(strassen_size, 3);
+            auto strassen_right = detail::random_matrix(strassen_size, 4);
+            // the crossover of the full size never recurses, the classic kernel is the baseline
+            std::vector<std::size_t> crossovers{ 64, 128, 256, 512 };
+            if (strassen_size > crossovers.back()) {
+                crossovers.push_back(strassen_size);
+            }
+            search(log, "strassen_crossover", &parameters::strassen_crossover, crossovers, 1, [&]() {
+                sink = strassen_left.multiply_strassen(strassen_right)(0, 0);
+            });
+        }
+
+        const std::uint32_t transpose_size = quick ? 1024 : 2048;
+        {
+            auto source = detail::random_matrix(transpose_size, 5);
+            search(log, "transpose_block", &parameters::transpose_block, { 16, 32, 64, 128, 256 }, repeat, [&]() {
+                sink = source.transpose()(0, 0);
+            });
+        }
+
+        if (backend::blas_available()) {
+            // the crossover search toggles the backend through the threshold: zero routes everything to it
+            crossover(log, "backend_threshold", &parameters::backend_threshold, { 16, 32, 64, 96, 128, 192, 256 }, repeat, [&](std::size_t size) {
+                backend::current().threshold = tuned.backend_threshold;
+                const auto& a = input(static_cast<double>(size));
+                sink = (a * a)(0, 0);
+            });
+            backend::current().threshold = tuned.backend_threshold;
+        }
+
+        if (!parallel) {
+            log << "parallel thresholds: kept, the kernels run on one thread\n";
+            return tuned;
+        }
+
+        crossover(log, "parallel_gemm_threshold", &parameters::parallel_gemm_threshold, { 1 << 12, 1 << 15, 1 << 18, 1 << 21 }, repeat, [&](std::size_t size) {
+            const auto& a = input(std::cbrt(static_cast<double>(size)));
+            sink = (a * a)(0, 0);
+        });
+
+        crossover(log, "parallel_transpose_threshold", &parameters::parallel_transpose_threshold, { 1 << 12, 1 << 14, 1 << 16, 1 << 18, 1 << 20 }, repeat, [&](std::size_t size) {
+            sink = input(std::sqrt(static_cast<double>(size))).transpose()(0, 0);
+        });
+
+        crossover(log, "elementwise_parallel_threshold", &parameters::elementwise_parallel_threshold, { 1 << 12, 1 << 14, 1 << 16, 1 << 18, 1 << 20 }, repeat, [&](std::size_t size) {
+            const auto& a = input(std::sqrt(static_cast<double>(size)));
+            sink = a.hadamard(a)(0, 0);
+        });
+
+        crossover(log, "reduction_parallel_threshold", &parameters::reduction_parallel_threshold, { 1 << 12, 1 << 14, 1 << 16, 1 << 18, 1 << 20 }, repeat, [&](std::size_t size) {
+            sink = input(std::sqrt(static_cast<double>(size))).sum();
+        });
+
+        // trailing updates of a Cholesky factorization of size n hold about n^3 / 3 multiply-adds
+        crossover(log, "factorization_parallel_threshold", &parameters::factorization_parallel_threshold, { 1 << 15, 1 << 18, 1 << 21, 1 << 24 }, repeat, [&](std::size_t size) {
+            sink = input(std::cbrt(3.0 * size)).cholesky()(0, 0);
+        });
+
+        crossover(log, "fixed_parallel_threshold", &parameters::fixed_parallel_threshold, { 8 * 8 * 8, 16 * 16 * 16, 32 * 32 * 32, 64 * 64 * 64 }, repeat, [&](std::size_t size) {
+            switch (size) {
+            case 8 * 8 * 8: detail::fixed_multiply<8>(); break;
+            case 16 * 16 * 16: detail::fixed_multiply<16>(); break;
+            case 32 * 32 * 32: detail::fixed_multiply<32>(); break;
+            default: detail::fixed_multiply<64>(); break;
+            }
+        });
+
+        return tuned;
+    }
+}
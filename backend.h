@@ -0,0 +1,187 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "utility.h"
+
+// External BLAS/LAPACK dispatch. Compiled in when MATRICES_WITH_BLAS is defined (CMake option MATRICES_USE_BLAS),
+// the built-in kernels remain the fallback for small sizes, other element types and builds without a backend.
+#ifdef MATRICES_WITH_BLAS
+extern "C" {
+    void dgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k,
+        const double* alpha, const double* a, const int* lda, const double* b, const int* ldb,
+        const double* beta, double* c, const int* ldc);
+    void sgemm_(const char* transa, const char* transb, const int* m, const int* n, const int* k,
+        const float* alpha, const float* a, const int* lda, const float* b, const int* ldb,
+        const float* beta, float* c, const int* ldc);
+    void dgetrf_(const int* m, const int* n, double* a, const int* lda, int* ipiv, int* info);
+    void dgetri_(const int* n, double* a, const int* lda, const int* ipiv, double* work, const int* lwork, int* info);
+    void dgetrs_(const char* trans, const int* n, const int* nrhs, const double* a, const int* lda,
+        const int* ipiv, double* b, const int* ldb, int* info);
+}
+#endif
+
+namespace matrices::backend {
+    enum class Kind : short {
+        Builtin,
+        Blas
+    };
+
+    [[nodiscard]] constexpr bool blas_available() {
+#ifdef MATRICES_WITH_BLAS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    [[nodiscard]] inline Kind default_kind() {
+        if (const char* value = std::getenv("MATRICES_BACKEND"); value != nullptr && std::string(value) == "builtin") {
+            return Kind::Builtin;
+        }
+        return blas_available() ? Kind::Blas : Kind::Builtin;
+    }
+
+    struct settings {
+        Kind kind{ default_kind() };
+        // smallest dimension from which the external backend is used
+        std::size_t threshold{ 128 };
+    };
+
+    [[nodiscard]] inline settings& current() {
+        static settings instance{};
+        return instance;
+    }
+
+    inline void select(const Kind& kind) {
+        if (kind == Kind::Blas && !blas_available()) {
+            throw std::runtime_error("Backend selection: built without BLAS/LAPACK support");
+        }
+        current().kind = kind;
+    }
+
+    [[nodiscard]] inline bool use_external(std::size_t dimension) {
+        return blas_available() && current().kind == Kind::Blas && dimension >= current().threshold;
+    }
+
+    // c = alpha * op(a) * op(b) + beta * c over row-major buffers. Returns false when the call is not routed
+    // to the external backend and the caller has to use its own kernel.
+    template<typename T>
+    [[nodiscard]] bool gemm([[maybe_unused]] utility::Transposition a_op, [[maybe_unused]] utility::Transposition b_op, std::size_t m, std::size_t n, std::size_t k,
+        [[maybe_unused]] const T& alpha, [[maybe_unused]] const T* a, [[maybe_unused]] std::size_t lda, [[maybe_unused]] const T* b,
+        [[maybe_unused]] std::size_t ldb, [[maybe_unused]] const T& beta, [[maybe_unused]] T* c, [[maybe_unused]] std::size_t ldc) {
+        if constexpr (std::is_same_v<T, double> || std::is_same_v<T, float>) {
+            if (!use_external(std::max({ m, n, k }))) {
+                return false;
+            }
+#ifdef MATRICES_WITH_BLAS
+            // a row-major matrix is its column-major transpose: compute c^T = op(b)^T * op(a)^T
+            char transa = a_op == utility::Transposition::None ? 'N' : 'T';
+            char transb = b_op == utility::Transposition::None ? 'N' : 'T';
+            int rows = static_cast<int>(n), cols = static_cast<int>(m), depth = static_cast<int>(k);
+            int ld_a = static_cast<int>(lda), ld_b = static_cast<int>(ldb), ld_c = static_cast<int>(ldc);
+
+            if constexpr (std::is_same_v<T, double>) {
+                dgemm_(&transb, &transa, &rows, &cols, &depth, &alpha, b, &ld_b, a, &ld_a, &beta, c, &ld_c);
+            }
+            else {
+                sgemm_(&transb, &transa, &rows, &cols, &depth, &alpha, b, &ld_b, a, &ld_a, &beta, c, &ld_c);
+            }
+            return true;
+#endif
+        }
+        return false;
+    }
+
+    // Inverts the row-major n x n buffer in place. Returns false when not routed to the external backend.
+    [[nodiscard]] inline bool inverse([[maybe_unused]] double* a, std::size_t n) {
+        if (!use_external(n)) {
+            return false;
+        }
+#ifdef MATRICES_WITH_BLAS
+        // inverse(a^T) == inverse(a)^T, so the row-major layout can be passed as is
+        int size = static_cast<int>(n), info = 0;
+        std::vector<int> pivots(n);
+
+        dgetrf_(&size, &size, a, &size, pivots.data(), &info);
+        if (info != 0) {
+            throw std::runtime_error("Inverse matrix operation: Invertible matrix");
+        }
+
+        int lwork = -1;
+        double optimal_work{ 0 };
+        dgetri_(&size, a, &size, pivots.data(), &optimal_work, &lwork, &info);
+        if (info != 0) {
+            throw std::runtime_error("Inverse matrix operation: can't calculate matrix");
+        }
+
+        lwork = std::max(1, static_cast<int>(optimal_work));
+        std::vector<double> work(lwork);
+        dgetri_(&size, a, &size, pivots.data(), work.data(), &lwork, &info);
+        if (info != 0) {
+            throw std::runtime_error("Inverse matrix operation: can't calculate matrix");
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Solves a * x = b for the row-major n x n buffer a and n x nrhs buffer b, x overwrites b and a is destroyed.
+    // Returns false when not routed to the external backend.
+    [[nodiscard]] inline bool solve([[maybe_unused]] double* a, std::size_t n, [[maybe_unused]] double* b, [[maybe_unused]] std::size_t nrhs) {
+        if (!use_external(n)) {
+            return false;
+        }
+#ifdef MATRICES_WITH_BLAS
+        int size = static_cast<int>(n), columns = static_cast<int>(nrhs), info = 0;
+        std::vector<int> pivots(n);
+
+        // a is seen as a^T by LAPACK, factorize it and solve with the transposed system
+        dgetrf_(&size, &size, a, &size, pivots.data(), &info);
+        if (info != 0) {
+            throw std::runtime_error("Solve operation: The matrix is singular");
+        }
+
+        std::vector<double> column_major(n * nrhs);
+        for (std::size_t ri = 0; ri < n; ++ri) {
+            for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                column_major[ci * n + ri] = b[ri * nrhs + ci];
+            }
+        }
+
+        char trans = 'T';
+        dgetrs_(&trans, &size, &columns, a, &size, pivots.data(), column_major.data(), &size, &info);
+        if (info != 0) {
+            throw std::runtime_error("Solve operation: can't solve the system");
+        }
+
+        for (std::size_t ri = 0; ri < n; ++ri) {
+            for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                b[ri * nrhs + ci] = column_major[ci * n + ri];
+            }
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,423 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <format>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <map>
+#include <filesystem>
+
+#include "matrices.h"
+#include "serializer.h"
+
+#include "boost/program_options.hpp"
+
+// Throughput benchmark of the matrix kernels, decompositions and serialization. Every case is timed over
+// `repeat` samples after a warm up run, short operations are batched so that a sample lasts at least a
+// millisecond. Results can be saved as JSON and compared against a saved baseline.
+namespace {
+    volatile double sink{ 0.0 };
+
+    struct statistics {
+        double min_ms{ 0.0 };
+        double median_ms{ 0.0 };
+        double mean_ms{ 0.0 };
+        double stddev_ms{ 0.0 };
+    };
+
+    struct result {
+        std::string name;
+        std::string kind;
+        std::string operation;
+        std::string type;
+        std::uint32_t size{ 0 };
+        statistics time;
+        double throughput{ 0.0 };
+        std::string unit;
+    };
+
+    // Time per call of `operation` in milliseconds over `repeat` samples.
+    statistics measure(std::uint32_t repeat, const std::function<void()>& operation) {
+        using clock = std::chrono::steady_clock;
+
+        auto start = clock::now();
+        operation();
+        std::chrono::duration<double, std::milli> warm_up = clock::now() - start;
+
+        constexpr double minimal_sample_ms = 1.0;
+        auto batch = warm_up.count() >= minimal_sample_ms ? std::size_t{ 1 } :
+            static_cast<std::size_t>(std::min(1e6, std::ceil(minimal_sample_ms / std::max(warm_up.count(), 1e-6))));
+
+        std::vector<double> samples;
+        samples.reserve(repeat);
+        for (std::uint32_t run = 0; run < repeat; ++run) {
+            start = clock::now();
+            for (std::size_t call = 0; call < batch; ++call) {
+                operation();
+            }
+            std::chrono::duration<double, std::milli> elapsed = clock::now() - start;
+            samples.push_back(elapsed.count() / static_cast<double>(batch));
+        }
+
+        std::sort(std::begin(samples), std::end(samples));
+
+        statistics result;
+        result.min_ms = samples.front();
+        result.median_ms = samples.size() % 2 == 1 ? samples[samples.size() / 2] : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2.0;
+        result.mean_ms = std::accumulate(std::begin(samples), std::end(samples), 0.0) / static_cast<double>(samples.size());
+
+        double variance{ 0.0 };
+        for (auto sample : samples) {
+            variance += (sample - result.mean_ms) * (sample - result.mean_ms);
+        }
+        result.stddev_ms = samples.size() > 1 ? std::sqrt(variance / static_cast<double>(samples.size() - 1)) : 0.0;
+        return result;
+    }
+
+    // silences the "Loaded from" and "Exported to" lines of the serializer while it is benchmarked
+    class quiet_output final {
+        std::ostringstream discard;
+        std::streambuf* previous;
+    public:
+        quiet_output() : previous(std::cout.rdbuf(discard.rdbuf())) {
+        }
+
+        ~quiet_output() {
+            std::cout.rdbuf(previous);
+        }
+    };
+
+    template<typename T>
+    matrices::matrix_d<T> random_dynamic(std::uint32_t size, std::uint32_t seed) {
+        std::mt19937_64 engine(seed);
+        std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+        std::vector<T> values(static_cast<std::size_t>(size) * size);
+        for (auto& value : values) {
+            value = static_cast<T>(distribution(engine));
+        }
+
+        // diagonal dominance keeps the inverse and the decompositions well conditioned
+        for (std::uint32_t index = 0; index < size; ++index) {
+            values[static_cast<std::size_t>(index) * size + index] += static_cast<T>(size);
+        }
+
+        return matrices::matrix_d<T>(size, size, std::move(values));
+    }
+
+    template<typename T, std::uint32_t Size>
+    matrices::matrix_f<T, Size> random_fixed(std::uint32_t seed) {
+        std::mt19937_64 engine(seed);
+        std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+        matrices::matrix_f<T, Size> result;
+        for (auto& value : result.data) {
+            value = static_cast<T>(distribution(engine));
+        }
+        for (std::uint32_t index = 0; index < Size; ++index) {
+            result(index, index) += static_cast<T>(Size);
+        }
+        return result;
+    }
+
+    class suite final {
+        std::uint32_t repeat;
+        std::string filter;
+        std::vector<result> results;
+    public:
+        suite(std::uint32_t repeat, std::string filter) : repeat(repeat), filter(std::move(filter)) {
+        }
+
+        // `work` is the flop count (unit GFLOP/s) or the byte count (unit GB/s) of one call
+        void run(const std::string& kind, const std::string& operation, const std::string& type, std::uint32_t size,
+            double work, const std::string& unit, const std::function<void()>& function) {
+            auto name = std::format("{}/{}/{}/{}", kind, operation, type, size);
+            if (!filter.empty() && name.find(filter) == std::string::npos) {
+                return;
+            }
+
+            auto time = measure(repeat, function);
+            auto throughput = work / (time.median_ms * 1e6);
+            results.push_back({ name, kind, operation, type, size, time, throughput, unit });
+
+            std::cout << std::format("{:<40} {:>12.4f} {:>12.4f} {:>10.4f} {:>12.3f} {}\n",
+                name, time.median_ms, time.min_ms, time.stddev_ms, throughput, unit);
+        }
+
+        [[nodiscard]] const std::vector<result>& get_results() const {
+            return results;
+        }
+    };
+
+    template<typename T>
+    void dynamic_cases(suite& benchmarks, const std::string& type, std::uint32_t size, std::uint32_t seed) {
+        const double n = size;
+        auto first = random_dynamic<T>(size, seed);
+        auto second = random_dynamic<T>(size, seed + 1);
+
+        benchmarks.run("dynamic", "multiply", type, size, 2.0 * n * n * n, "GFLOP/s", [&]() {
+            sink = (first * second)(0, 0);
+        });
+
+        // one thread per element, only meaningful for small sizes
+        if (size <= 64) {
+            benchmarks.run("dynamic", "multiply_with_threads", type, size, 2.0 * n * n * n, "GFLOP/s", [&]() {
+                sink = first.multiply_with_threads(second)(0, 0);
+            });
+        }
+
+        benchmarks.run("dynamic", "transpose", type, size, 2.0 * n * n * sizeof(T), "GB/s", [&]() {
+            sink = first.transpose()(0, 0);
+        });
+
+        benchmarks.run("dynamic", "inverse", type, size, 2.0 * n * n * n, "GFLOP/s", [&]() {
+            sink = first.inverse()(0, 0);
+        });
+
+        if constexpr (std::is_same_v<T, double>) {
+            auto spd = first.transpose() * first;
+
+            benchmarks.run("dynamic", "solve", type, size, 2.0 / 3.0 * n * n * n + 2.0 * n * n * n, "GFLOP/s", [&]() {
+                sink = first.solve(second)(0, 0);
+            });
+
+            benchmarks.run("dynamic", "cholesky", type, size, n * n * n / 3.0, "GFLOP/s", [&]() {
+                sink = spd.cholesky()(0, 0);
+            });
+
+            benchmarks.run("dynamic", "qr", type, size, 4.0 / 3.0 * n * n * n, "GFLOP/s", [&]() {
+                sink = first.qr().second(0, 0);
+            });
+
+            auto path = std::filesystem::temp_directory_path() / std::format("matrices_benchmark_{}.csv", size);
+            {
+                quiet_output quiet;
+                matrices::serialize::to_csv(path, first, ',');
+            }
+            const double file_bytes = static_cast<double>(std::filesystem::file_size(path));
+
+            benchmarks.run("dynamic", "to_csv", type, size, file_bytes, "GB/s", [&]() {
+                quiet_output quiet;
+                matrices::serialize::to_csv(path, first, ',');
+            });
+
+            benchmarks.run("dynamic", "from_csv", type, size, file_bytes, "GB/s", [&]() {
+                quiet_output quiet;
+                sink = matrices::serialize::from_csv(path)(0, 0);
+            });
+
+            std::error_code error;
+            std::filesystem::remove(path, error);
+        }
+    }
+
+    template<typename T, std::uint32_t Size>
+    void fixed_cases(suite& benchmarks, const std::string& type, std::uint32_t seed) {
+        const double n = Size;
+        auto first = random_fixed<T, Size>(seed);
+        auto second = random_fixed<T, Size>(seed + 1);
+
+        benchmarks.run("fixed", "multiply", type, Size, 2.0 * n * n * n, "GFLOP/s", [&]() {
+            sink = (first * second)(0, 0);
+        });
+
+        benchmarks.run("fixed", "multiply_with_threads", type, Size, 2.0 * n * n * n, "GFLOP/s", [&]() {
+            sink = first.multiply_with_threads(second)(0, 0);
+        });
+
+        benchmarks.run("fixed", "transpose", type, Size, 2.0 * n * n * sizeof(T), "GB/s", [&]() {
+            sink = first.transpose()(0, 0);
+        });
+
+        benchmarks.run("fixed", "inverse_2", type, Size, 2.0 * n * n * n, "GFLOP/s", [&]() {
+            sink = first.inverse_2()(0, 0);
+        });
+
+        // cofactor expansion, factorial cost
+        if constexpr (Size <= 6) {
+            benchmarks.run("fixed", "inverse_1", type, Size, 2.0 * n * n * n, "GFLOP/s", [&]() {
+                sink = first.inverse_1()(0, 0);
+            });
+        }
+    }
+
+    template<typename T>
+    void all_fixed_cases(suite& benchmarks, const std::string& type, std::uint32_t seed) {
+        fixed_cases<T, 4>(benchmarks, type, seed);
+        fixed_cases<T, 8>(benchmarks, type, seed);
+        fixed_cases<T, 16>(benchmarks, type, seed);
+        fixed_cases<T, 32>(benchmarks, type, seed);
+    }
+
+    void write_json(const std::filesystem::path& path, const std::vector<result>& results) {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file for writting");
+        }
+
+        // one benchmark per line, which is also what read_baseline relies on
+        file << "{\n  \"benchmarks\": [\n";
+        for (std::size_t index = 0; index < results.size(); ++index) {
+            const auto& item = results[index];
+            file << std::format("    {{\"name\": \"{}\", \"kind\": \"{}\", \"operation\": \"{}\", \"type\": \"{}\", \"size\": {}, "
+                "\"min_ms\": {}, \"median_ms\": {}, \"mean_ms\": {}, \"stddev_ms\": {}, \"throughput\": {}, \"unit\": \"{}\"}}{}\n",
+                item.name, item.kind, item.operation, item.type, item.size, item.time.min_ms, item.time.median_ms,
+                item.time.mean_ms, item.time.stddev_ms, item.throughput, item.unit, index + 1 < results.size() ? "," : "");
+        }
+        file << "  ]\n}\n";
+    }
+
+    // name -> median time of a file written by write_json
+    std::map<std::string, double> read_baseline(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file for reading");
+        }
+
+        auto field = [](const std::string& line, const std::string& key) -> std::string {
+            auto position = line.find("\"" + key + "\":");
+            if (position == std::string::npos) {
+                return {};
+            }
+            position = line.find_first_not_of(" \"", position + key.size() + 3);
+            auto end = line.find_first_of(",\"}", position);
+            return line.substr(position, end - position);
+        };
+
+        std::map<std::string, double> result;
+        for (std::string line; std::getline(file, line);) {
+            auto name = field(line, "name");
+            auto median = field(line, "median_ms");
+            if (!name.empty() && !median.empty()) {
+                result[name] = std::stod(median);
+            }
+        }
+        return result;
+    }
+
+    // Prints the relative change of every case found in the baseline, returns the number of regressions.
+    std::size_t compare(const std::map<std::string, double>& baseline, const std::vector<result>& results, double threshold_percent) {
+        std::size_t regressions{ 0 };
+        std::cout << std::format("\n{:<40} {:>12} {:>12} {:>9}\n", "comparison", "baseline ms", "current ms", "change");
+
+        for (const auto& item : results) {
+            auto found = baseline.find(item.name);
+            if (found == baseline.end() || found->second <= 0.0) {
+                continue;
+            }
+
+            auto change = (item.time.median_ms / found->second - 1.0) * 100.0;
+            std::string verdict;
+            if (change > threshold_percent) {
+                verdict = "REGRESSION";
+                ++regressions;
+            }
+            else if (change < -threshold_percent) {
+                verdict = "improved";
+            }
+
+            std::cout << std::format("{:<40} {:>12.4f} {:>12.4f} {:>8.1f}% {}\n", item.name, found->second, item.time.median_ms, change, verdict);
+        }
+
+        std::cout << std::format("{} regression(s) above {}%\n", regressions, threshold_percent);
+        return regressions;
+    }
+}
+
+int main(int argc, char** argv) {
+    boost::program_options::options_description options("Matrices benchmark");
+    options.add_options()
+        ("help", "produce help message")
+        ("sizes", boost::program_options::value<std::vector<std::uint32_t>>()->multitoken()->default_value({ 16, 32, 128, 512 }, "16 32 128 512"), "dynamic matrix sizes")
+        ("types", boost::program_options::value<std::vector<std::string>>()->multitoken()->default_value({ "double", "float" }, "double float"), "element types: double, float")
+        ("no-fixed", "skip the fixed size matrices (4, 8, 16, 32)")
+        ("repeat", boost::program_options::value<std::uint32_t>()->default_value({ 5 }), "samples per case")
+        ("filter", boost::program_options::value<std::string>()->default_value({ "" }, ""), "run only the cases whose name contains this text")
+        ("seed", boost::program_options::value<std::uint32_t>()->default_value({ 42 }), "random inputs seed")
+        ("json", boost::program_options::value<std::string>(), "write the results to this JSON file")
+        ("compare", boost::program_options::value<std::string>(), "baseline JSON file to compare against")
+        ("threshold", boost::program_options::value<double>()->default_value({ 10.0 }), "slowdown in percent reported as a regression");
+
+    boost::program_options::variables_map v_maps;
+    try {
+        boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), v_maps);
+        boost::program_options::notify(v_maps);
+    }
+    catch (std::exception& e) {
+        std::cout << e.what() << std::endl;
+        options.print(std::cout);
+        return 1;
+    }
+
+    if (v_maps.contains("help")) {
+        options.print(std::cout);
+        return 0;
+    }
+
+    auto repeat = std::max<std::uint32_t>(1, v_maps["repeat"].as<std::uint32_t>());
+    auto seed = v_maps["seed"].as<std::uint32_t>();
+    auto types = v_maps["types"].as<std::vector<std::string>>();
+    suite benchmarks(repeat, v_maps["filter"].as<std::string>());
+
+    std::cout << std::format("{:<40} {:>12} {:>12} {:>10} {:>12}\n", "case", "median ms", "min ms", "stddev", "throughput");
+
+    try {
+        for (const auto& type : types) {
+            if (type != "double" && type != "float") {
+                std::cout << std::format("Unknown element type {}\n", type);
+                return 1;
+            }
+
+            for (auto size : v_maps["sizes"].as<std::vector<std::uint32_t>>()) {
+                if (type == "double") {
+                    dynamic_cases<double>(benchmarks, type, size, seed);
+                }
+                else {
+                    dynamic_cases<float>(benchmarks, type, size, seed);
+                }
+            }
+
+            if (!v_maps.contains("no-fixed")) {
+                if (type == "double") {
+                    all_fixed_cases<double>(benchmarks, type, seed);
+                }
+                else {
+                    all_fixed_cases<float>(benchmarks, type, seed);
+                }
+            }
+        }
+
+        if (v_maps.contains("json")) {
+            write_json(v_maps["json"].as<std::string>(), benchmarks.get_results());
+        }
+
+        if (v_maps.contains("compare")) {
+            auto baseline = read_baseline(v_maps["compare"].as<std::string>());
+            if (compare(baseline, benchmarks.get_results(), v_maps["threshold"].as<double>()) > 0) {
+                return 2;
+            }
+        }
+    }
+    catch (std::exception& e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
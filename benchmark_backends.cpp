@@ -0,0 +1,125 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <format>
+#include <functional>
+
+#include "matrices.h"
+
+#include "boost/program_options.hpp"
+
+namespace {
+    matrices::matrix_d<double> random_matrix(std::uint32_t rows, std::uint32_t cols, std::uint32_t seed) {
+        std::mt19937_64 engine(seed);
+        std::uniform_real_distribution<double> distribution(-1.0, 1.0);
+
+        std::vector<double> values(static_cast<std::size_t>(rows) * cols);
+        for (auto& value : values) {
+            value = distribution(engine);
+        }
+
+        // diagonal dominance keeps inverse and solve well conditioned
+        for (std::uint32_t index = 0; index < std::min(rows, cols); ++index) {
+            values[static_cast<std::size_t>(index) * cols + index] += cols;
+        }
+
+        return matrices::matrix_d<double>(rows, cols, std::move(values));
+    }
+
+    double max_difference(const matrices::matrix_d<double>& first, const matrices::matrix_d<double>& second) {
+        double result{ 0.0 };
+        for (std::uint32_t ri = 0; ri < first.get_rows_count(); ++ri) {
+            for (std::uint32_t ci = 0; ci < first.get_columns_count(); ++ci) {
+                result = std::max(result, std::abs(first(ri, ci) - second(ri, ci)));
+            }
+        }
+        return result;
+    }
+
+    // best of `repeat` runs in milliseconds, the last result is kept for comparison
+    double measure(std::uint32_t repeat, const std::function<matrices::matrix_d<double>()>& operation, matrices::matrix_d<double>& result) {
+        double best = std::numeric_limits<double>::max();
+        for (std::uint32_t run = 0; run < repeat; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            result = operation();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+}
+
+int main(int argc, char** argv) {
+    boost::program_options::options_description options("Backend benchmark");
+    options.add_options()
+        ("help", "produce help message")
+        ("sizes", boost::program_options::value<std::vector<std::uint32_t>>()->multitoken()->default_value({ 128, 256, 512 }, "128 256 512"), "square matrix sizes")
+        ("repeat", boost::program_options::value<std::uint32_t>()->default_value({ 3 }), "runs per measurement (best is reported)")
+        ("seed", boost::program_options::value<std::uint32_t>()->default_value({ 42 }), "random inputs seed");
+
+    boost::program_options::variables_map v_maps;
+    try {
+        boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), v_maps);
+        boost::program_options::notify(v_maps);
+    }
+    catch (std::exception& e) {
+        std::cout << e.what() << std::endl;
+        options.print(std::cout);
+        return 1;
+    }
+
+    if (v_maps.contains("help")) {
+        options.print(std::cout);
+        return 0;
+    }
+
+    if (!matrices::backend::blas_available()) {
+        std::cout << "Built without BLAS/LAPACK (configure with -DMATRICES_USE_BLAS=ON), only the built-in backend is measured\n";
+    }
+
+    auto repeat = std::max<std::uint32_t>(1, v_maps["repeat"].as<std::uint32_t>());
+    auto seed = v_maps["seed"].as<std::uint32_t>();
+    matrices::backend::current().threshold = 0;
+
+    std::cout << std::format("{:>10} {:>6} {:>14} {:>14} {:>14}\n", "operation", "size", "builtin, ms", "blas, ms", "max diff");
+
+    for (auto size : v_maps["sizes"].as<std::vector<std::uint32_t>>()) {
+        auto first = random_matrix(size, size, seed);
+        auto second = random_matrix(size, size, seed + 1);
+
+        std::vector<std::pair<std::string, std::function<matrices::matrix_d<double>()>>> operations{
+            { "multiply", [&]() { return first * second; } },
+            { "inverse", [&]() { return first.inverse(); } },
+            { "solve", [&]() { return first.solve(second); } } };
+
+        for (auto& [name, operation] : operations) {
+            matrices::matrix_d<double> builtin_result, blas_result;
+
+            matrices::backend::select(matrices::backend::Kind::Builtin);
+            auto builtin_time = measure(repeat, operation, builtin_result);
+
+            if (matrices::backend::blas_available()) {
+                matrices::backend::select(matrices::backend::Kind::Blas);
+                auto blas_time = measure(repeat, operation, blas_result);
+                std::cout << std::format("{:>10} {:>6} {:>14.3f} {:>14.3f} {:>14.3e}\n", name, size, builtin_time, blas_time, max_difference(builtin_result, blas_result));
+            }
+            else {
+                std::cout << std::format("{:>10} {:>6} {:>14.3f} {:>14} {:>14}\n", name, size, builtin_time, "-", "-");
+            }
+        }
+    }
+
+    return 0;
+}
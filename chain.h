@@ -0,0 +1,143 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Products of several matrices evaluated in the cheapest order.
+namespace matrices::chain {
+    // Optimal parenthesization of a chain of `count` matrices, matrix i being dimensions[i] x dimensions[i + 1].
+    // Classic O(count^3) dynamic programming over the number of scalar multiplications.
+    class plan final {
+        std::size_t count{ 0 };
+        std::vector<std::uint64_t> costs;
+        std::vector<std::size_t> splits;
+
+        [[nodiscard]] std::size_t index(std::size_t first, std::size_t last) const {
+            return first * count + last;
+        }
+
+        [[nodiscard]] std::string describe(std::size_t first, std::size_t last) const {
+            if (first == last) {
+                return "M" + std::to_string(first + 1);
+            }
+
+            auto split = splits[index(first, last)];
+            return "(" + describe(first, split) + " * " + describe(split + 1, last) + ")";
+        }
+    public:
+        explicit plan(const std::vector<std::size_t>& dimensions) {
+            if (dimensions.size() < 2) {
+                throw std::runtime_error("Chain multiply operation: no operands");
+            }
+
+            count = dimensions.size() - 1;
+            costs.assign(count * count, 0);
+            splits.assign(count * count, 0);
+
+            for (std::size_t length = 2; length <= count; ++length) {
+                for (std::size_t first = 0; first + length <= count; ++first) {
+                    auto last = first + length - 1;
+                    auto& best = costs[index(first, last)];
+                    best = std::numeric_limits<std::uint64_t>::max();
+
+                    for (auto split = first; split < last; ++split) {
+                        std::uint64_t cost = costs[index(first, split)] + costs[index(split + 1, last)] +
+                            static_cast<std::uint64_t>(dimensions[first]) * dimensions[split + 1] * dimensions[last + 1];
+                        if (cost < best) {
+                            best = cost;
+                            splits[index(first, last)] = split;
+                        }
+                    }
+                }
+            }
+        }
+
+        [[nodiscard]] std::size_t operands_count() const {
+            return count;
+        }
+
+        // scalar multiplications of the optimal order
+        [[nodiscard]] std::uint64_t cost() const {
+            return costs[index(0, count - 1)];
+        }
+
+        // the product of [first, last] is evaluated as [first, split] * [split + 1, last]
+        [[nodiscard]] std::size_t split(std::size_t first, std::size_t last) const {
+            return splits.at(index(first, last));
+        }
+
+        [[nodiscard]] std::string to_string() const {
+            return describe(0, count - 1);
+        }
+    };
+
+    // Scalar multiplications of the plain left to right evaluation, for comparison with plan::cost().
+    [[nodiscard]] inline std::uint64_t left_to_right_cost(const std::vector<std::size_t>& dimensions) {
+        std::uint64_t result{ 0 };
+        for (std::size_t index = 2; index < dimensions.size(); ++index) {
+            result += static_cast<std::uint64_t>(dimensions[0]) * dimensions[index - 1] * dimensions[index];
+        }
+        return result;
+    }
+
+    template<typename Matrix>
+    [[nodiscard]] std::vector<std::size_t> dimensions(const std::vector<Matrix>& operands) {
+        if (operands.empty()) {
+            throw std::runtime_error("Chain multiply operation: no operands");
+        }
+
+        std::vector<std::size_t> result{ operands.front().get_rows_count() };
+        for (const auto& operand : operands) {
+            if (operand.get_rows_count() != result.back()) {
+                throw std::runtime_error("Chain multiply operation: The conditions of the operation are not met");
+            }
+            result.push_back(operand.get_columns_count());
+        }
+        return result;
+    }
+
+    // Single operands of a split are used in place, only the intermediate products are allocated.
+    template<typename Matrix>
+    [[nodiscard]] Matrix multiply(const std::vector<Matrix>& operands, const plan& order, std::size_t first, std::size_t last) {
+        if (first == last) {
+            return operands[first];
+        }
+
+        auto split = order.split(first, last);
+        const bool left_operand = split == first;
+        const bool right_operand = split + 1 == last;
+
+        if (left_operand && right_operand) {
+            return operands[first] * operands[last];
+        }
+        if (left_operand) {
+            return operands[first] * multiply(operands, order, split + 1, last);
+        }
+        if (right_operand) {
+            return multiply(operands, order, first, split) * operands[last];
+        }
+        return multiply(operands, order, first, split) * multiply(operands, order, split + 1, last);
+    }
+
+    // operands[0] * operands[1] * ... evaluated in the optimal order.
+    template<typename Matrix>
+    [[nodiscard]] Matrix multiply(const std::vector<Matrix>& operands) {
+        plan order(dimensions(operands));
+        return multiply(operands, order, 0, operands.size() - 1);
+    }
+}
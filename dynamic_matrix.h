@@ -14,20 +14,39 @@
 
 #include <vector>
 #include <ranges>
+#include <algorithm>
+#include <cmath>
+#include <span>
 
 #include "utility.h"
+#include "precision.h"
+#include "parallel.h"
+#include "backend.h"
+#include "strassen.h"
+#include "memory.h"
+#include "storage.h"
+#include "numa.h"
+#include "factorization.h"
+#include "reduction.h"
+#include "elementwise.h"
+#include "profiler.h"
+#include "tuning.h"
+#include "views.h"
 
 namespace matrices {
-    template<typename T> requires std::is_arithmetic_v<T>
+    template<typename T, typename Allocator = memory::pool_allocator<T>> requires utility::Element<T>
     class matrix_d final {
+        template<typename U, typename OtherAllocator> requires utility::Element<U>
+        friend class matrix_d;
+
         using internal_type = T;
         using index_type = std::uint32_t;
 
         index_type rows_count{ 0 };
         index_type columns_count{ 0 };
-        std::vector<internal_type> data{};
+        memory::shared_buffer<internal_type, Allocator> data{};
 
-        void requires_same_size_for_matrices(const matrix_d<T>& other) const {
+        void requires_same_size_for_matrices(const matrix_d& other) const {
             if (rows_count != other.rows_count || columns_count != other.columns_count) {
                 throw std::runtime_error("The dimensions of the matrices are not equal");
             }
@@ -46,16 +65,226 @@ namespace matrices {
             }
         }
 
+        static constexpr index_type transpose_micro_block = 8;
+
+        // Copies source[row_first..row_last) x [col_first..col_last) transposed into destination.
+        // Full 8x8 micro tiles are staged through a local buffer so both the loads and the stores
+        // run over contiguous memory and can be vectorized by the compiler.
+        static void transpose_tile(const internal_type* source, std::size_t source_stride, internal_type* destination, std::size_t destination_stride,
+            index_type row_first, index_type row_last, index_type col_first, index_type col_last) {
+            constexpr index_type micro = transpose_micro_block;
+
+            index_type ri = row_first;
+            for (; ri + micro <= row_last; ri += micro) {
+                index_type ci = col_first;
+                for (; ci + micro <= col_last; ci += micro) {
+                    internal_type tile[micro][micro];
+
+                    for (index_type r = 0; r < micro; ++r) {
+                        const auto* source_row = source + (ri + r) * source_stride + ci;
+                        for (index_type c = 0; c < micro; ++c) {
+                            tile[c][r] = source_row[c];
+                        }
+                    }
+
+                    for (index_type c = 0; c < micro; ++c) {
+                        auto* destination_row = destination + (ci + c) * destination_stride + ri;
+                        for (index_type r = 0; r < micro; ++r) {
+                            destination_row[r] = tile[c][r];
+                        }
+                    }
+                }
+
+                for (; ci < col_last; ++ci) {
+                    for (index_type r = 0; r < micro; ++r) {
+                        destination[ci * destination_stride + ri + r] = source[(ri + r) * source_stride + ci];
+                    }
+                }
+            }
+
+            for (; ri < row_last; ++ri) {
+                for (index_type ci = col_first; ci < col_last; ++ci) {
+                    destination[ci * destination_stride + ri] = source[ri * source_stride + ci];
+                }
+            }
+        }
+
+        void transpose_square_in_place() {
+            const auto& tuned = tuning::current();
+            const auto transpose_block = tuned.transpose_block;
+
+            auto* values = data.data();
+            const std::size_t n = rows_count;
+            auto blocks = (n + transpose_block - 1) / transpose_block;
+
+            auto swap_block_rows = [&](std::size_t first_block, std::size_t last_block) {
+                for (auto bi = first_block; bi < last_block; ++bi) {
+                    auto row_first = bi * transpose_block;
+                    auto row_last = std::min<std::size_t>(row_first + transpose_block, n);
+
+                    for (auto bj = bi; bj < blocks; ++bj) {
+                        auto col_first = bj * transpose_block;
+                        auto col_last = std::min<std::size_t>(col_first + transpose_block, n);
+
+                        for (auto ri = row_first; ri < row_last; ++ri) {
+                            for (auto ci = std::max(col_first, ri + 1); ci < col_last; ++ci) {
+                                std::swap(values[ri * n + ci], values[ci * n + ri]);
+                            }
+                        }
+                    }
+                }
+            };
+
+            if (data.size() < tuned.parallel_transpose_threshold) {
+                swap_block_rows(0, blocks);
+            }
+            else {
+                utility::parallel_for(0, blocks, 1, swap_block_rows);
+            }
+        }
+
+        void transpose_rectangular_in_place() {
+            const std::size_t size = data.size();
+            if (size < 3) {
+                return;
+            }
+
+            // element at index i = r * columns + c moves to c * rows + r == (i * rows) mod (size - 1)
+            const std::size_t modulus = size - 1;
+            std::vector<bool> visited(size, false);
+            auto* values = data.data();
+
+            for (std::size_t start = 1; start < modulus; ++start) {
+                if (visited[start]) {
+                    continue;
+                }
+
+                auto carried = values[start];
+                auto index = start;
+                do {
+                    auto next = static_cast<std::size_t>((static_cast<unsigned long long>(index) * rows_count) % modulus);
+                    std::swap(values[next], carried);
+                    visited[next] = true;
+                    index = next;
+                } while (index != start);
+            }
+        }
+
+        // c[m x n] += alpha * op(a)[m x k] * op(b)[k x n]. All buffers are row-major with leading dimensions
+        // lda, ldb and ldc. Transposed operands are read in place, only a depth block of b is packed when
+        // both operands are transposed.
+        static void gemm_kernel(utility::Transposition a_op, utility::Transposition b_op, std::size_t m, std::size_t n, std::size_t k,
+            const internal_type& alpha, const internal_type* a, std::size_t lda, const internal_type* b, std::size_t ldb, internal_type* c, std::size_t ldc,
+            bool allow_parallel = true) {
+            using utility::Transposition;
+
+            const auto& tuned = tuning::current();
+            const auto gemm_depth_block = tuned.gemm_depth_block;
+
+            auto run_rows = [&](auto&& update_rows) {
+                if (!allow_parallel || m * n * k < tuned.parallel_gemm_threshold) {
+                    update_rows(std::size_t{ 0 }, m);
+                }
+                else {
+                    numa::parallel_for(0, m, tuned.gemm_row_grain, update_rows);
+                }
+            };
+
+            if (a_op == Transposition::None && b_op == Transposition::Transpose) {
+                // rows of a and rows of b are both contiguous: plain dot products
+                run_rows([&](std::size_t first, std::size_t last) {
+                    for (auto ri = first; ri < last; ++ri) {
+                        const auto* a_row = a + ri * lda;
+                        auto* c_row = c + ri * ldc;
+
+                        for (std::size_t ci = 0; ci < n; ++ci) {
+                            const auto* b_row = b + ci * ldb;
+
+                            internal_type dot{ 0 };
+                            for (std::size_t p = 0; p < k; ++p) {
+                                dot += a_row[p] * b_row[p];
+                            }
+                            c_row[ci] += alpha * dot;
+                        }
+                    }
+                });
+                return;
+            }
+
+            memory::arena_scope scratch;
+            internal_type* packed{ nullptr };
+            if (b_op == Transposition::Transpose) {
+                packed = scratch.allocate<internal_type>(std::min<std::size_t>(gemm_depth_block, k) * n);
+            }
+
+            for (std::size_t depth_first = 0; depth_first < k; depth_first += gemm_depth_block) {
+                auto depth_last = std::min<std::size_t>(depth_first + gemm_depth_block, k);
+
+                const internal_type* panel = b + depth_first * ldb;
+                std::size_t panel_stride = ldb;
+
+                if (b_op == Transposition::Transpose) {
+                    for (std::size_t ci = 0; ci < n; ++ci) {
+                        const auto* b_row = b + ci * ldb;
+                        for (auto p = depth_first; p < depth_last; ++p) {
+                            packed[(p - depth_first) * n + ci] = b_row[p];
+                        }
+                    }
+                    panel = packed;
+                    panel_stride = n;
+                }
+
+                run_rows([&](std::size_t first, std::size_t last) {
+                    for (auto ri = first; ri < last; ++ri) {
+                        auto* c_row = c + ri * ldc;
+
+                        for (auto p = depth_first; p < depth_last; ++p) {
+                            auto a_value = a_op == Transposition::None ? a[ri * lda + p] : a[p * lda + ri];
+                            if (a_value == internal_type{ 0 }) {
+                                continue;
+                            }
+
+                            a_value *= alpha;
+                            const auto* panel_row = panel + (p - depth_first) * panel_stride;
+                            for (std::size_t ci = 0; ci < n; ++ci) {
+                                c_row[ci] += a_value * panel_row[ci];
+                            }
+                        }
+                    }
+                });
+            }
+        }
+
+        void scale(const internal_type& factor) {
+            if (factor == internal_type{ 0 }) {
+                std::fill(std::begin(data), std::end(data), internal_type{ 0 });
+            }
+            else if (factor != internal_type{ 1 }) {
+                for (auto& value : data) {
+                    value *= factor;
+                }
+            }
+        }
+
+        // Sizes the buffer and zero fills it, honouring the NUMA placement for large matrices.
+        void allocate_elements(index_type rows, index_type cols) {
+            data.resize(utility::multiply(rows, cols));
+            numa::first_touch(data.data(), rows, cols);
+        }
+
         void make_identity() {
             auto min_dim = std::min(rows_count, columns_count);
             for (index_type ri = 0; ri < min_dim; ++ri) {
-                operator()(ri, ri) = { 1 };
+                unchecked(ri, ri) = { 1 };
             }
         }
     public:
         matrix_d(index_type rows, index_type cols) : rows_count(rows), columns_count(cols) {
             try {
-                data.resize(utility::multiply(rows, cols));
+                allocate_elements(rows, cols);
+            }
+            catch (const memory::budget_exceeded&) {
+                throw;
             }
             catch (std::exception) {
                 rows = 0;
@@ -75,7 +304,10 @@ namespace matrices {
             : rows_count(num_rows), columns_count(num_cols) {
 
             try {
-                data.resize(utility::multiply(num_rows, num_cols));
+                allocate_elements(num_rows, num_cols);
+            }
+            catch (const memory::budget_exceeded&) {
+                throw;
             }
             catch (std::exception) {
                 rows_count = 0;
@@ -88,7 +320,7 @@ namespace matrices {
                 input_data.resize(data.size());
             }
 
-            std::move(begin(input_data), end(input_data), begin(data));
+            std::move(std::begin(input_data), std::end(input_data), std::begin(data));
         }
 
         template<utility::Scalar ...Args>
@@ -96,7 +328,10 @@ namespace matrices {
             : rows_count(num_rows), columns_count(num_cols) {
 
             try {
-                data.resize(utility::multiply(num_rows, num_cols));
+                allocate_elements(num_rows, num_cols);
+            }
+            catch (const memory::budget_exceeded&) {
+                throw;
             }
             catch (std::exception) {
                 rows_count = 0;
@@ -116,10 +351,11 @@ namespace matrices {
             }
         }
 
-        matrix_d(matrix_d<T>& other) = default;
-        matrix_d(matrix_d<T>&& other) = default;
-        matrix_d<T>& operator=(const matrix_d<T>& other) = default;
-        matrix_d<T>& operator=(matrix_d<T>&& other) = default;
+        // copies share the elements in O(1) until one of them is modified, see memory::shared_buffer
+        matrix_d(const matrix_d& other) = default;
+        matrix_d(matrix_d&& other) = default;
+        matrix_d& operator=(const matrix_d& other) = default;
+        matrix_d& operator=(matrix_d&& other) = default;
         ~matrix_d() = default;
 
         void add_row(index_type start_row, std::vector<internal_type>&& row_data) {
@@ -129,7 +365,9 @@ namespace matrices {
                 row_data.resize(columns_count);
             }
 
-            std::move(std::begin(row_data), std::end(row_data), start_position);
+            // a short row is zero padded, whatever the constructor left in the matrix
+            auto row_end = std::move(std::begin(row_data), std::end(row_data), start_position);
+            std::fill(row_end, std::next(start_position, columns_count), internal_type{ 0 });
         }
 
         index_type get_rows_count() const {
@@ -140,60 +378,412 @@ namespace matrices {
             return columns_count;
         }
 
+        // Bounds checked only with MATRICES_CHECKED_ACCESS (debug builds), see at() for an always checked access.
         [[nodiscard]] internal_type& operator()(const index_type& row, const index_type& col)
         {
-            if (row >= rows_count || col >= columns_count) {
-                std::out_of_range("Invalid row or column index");
+            if constexpr (checked_access) {
+                check_index(row < rows_count && col < columns_count);
             }
-            return data[row * columns_count + col];
+            return unchecked(row, col);
         }
 
         [[nodiscard]] internal_type operator()(const index_type& row, const index_type& col) const
         {
-            if (row >= rows_count || col >= columns_count) {
-                std::out_of_range("Invalid row or column index");
+            if constexpr (checked_access) {
+                check_index(row < rows_count && col < columns_count);
             }
-            return data[row * columns_count + col];
+            return unchecked(row, col);
         }
 
         [[nodiscard]] internal_type& operator[](const index_type& index)
         {
-            return data.at(index);
+            if constexpr (checked_access) {
+                check_index(index < data.size());
+            }
+            return data[index];
+        }
+
+        [[nodiscard]] internal_type operator[](const index_type& index) const
+        {
+            if constexpr (checked_access) {
+                check_index(index < data.size());
+            }
+            return data[index];
+        }
+
+        [[nodiscard]] internal_type& at(const index_type& row, const index_type& col) {
+            check_index(row < rows_count && col < columns_count);
+            return unchecked(row, col);
+        }
+
+        [[nodiscard]] internal_type at(const index_type& row, const index_type& col) const {
+            check_index(row < rows_count && col < columns_count);
+            return unchecked(row, col);
+        }
+
+        // Row major linear index, always checked.
+        [[nodiscard]] internal_type& at(const index_type& index) {
+            check_index(index < data.size());
+            return data[index];
+        }
+
+        [[nodiscard]] internal_type at(const index_type& index) const {
+            check_index(index < data.size());
+            return data[index];
+        }
+
+        // Element access of the inner loops, never checked.
+        [[nodiscard]] internal_type& unchecked(index_type row, index_type col) {
+            return data[static_cast<std::size_t>(row) * columns_count + col];
+        }
+
+        [[nodiscard]] internal_type unchecked(index_type row, index_type col) const {
+            return data[static_cast<std::size_t>(row) * columns_count + col];
+        }
+
+        // Row major elements as one contiguous range. The mutable accessors give the matrix its own copy of shared
+        // elements first. Pointers and views stay valid until the matrix is resized or moved from, and a copy of the
+        // matrix invalidates the mutable ones: take them again after copying, writes through old ones reach the copy.
+        [[nodiscard]] internal_type* begin() {
+            return data.data();
+        }
+
+        [[nodiscard]] internal_type* end() {
+            return data.data() + data.size();
+        }
+
+        [[nodiscard]] const internal_type* begin() const {
+            return data.data();
+        }
+
+        [[nodiscard]] const internal_type* end() const {
+            return data.data() + data.size();
+        }
+
+        [[nodiscard]] std::span<internal_type> row_span(index_type row) {
+            if constexpr (checked_access) {
+                check_index(row < rows_count);
+            }
+            return { data.data() + static_cast<std::size_t>(row) * columns_count, columns_count };
+        }
+
+        [[nodiscard]] std::span<const internal_type> row_span(index_type row) const {
+            if constexpr (checked_access) {
+                check_index(row < rows_count);
+            }
+            return { data.data() + static_cast<std::size_t>(row) * columns_count, columns_count };
+        }
+
+        [[nodiscard]] strided_span<internal_type> column_range(index_type col) {
+            if constexpr (checked_access) {
+                check_index(col < columns_count);
+            }
+            return { data.data() + col, rows_count, static_cast<std::ptrdiff_t>(columns_count) };
+        }
+
+        [[nodiscard]] strided_span<const internal_type> column_range(index_type col) const {
+            if constexpr (checked_access) {
+                check_index(col < columns_count);
+            }
+            return { data.data() + col, rows_count, static_cast<std::ptrdiff_t>(columns_count) };
         }
 
-        [[nodiscard]] matrix_d<T> operator*(const matrix_d<T>& other) const {
-            if (rows_count != other.columns_count) {
+        [[nodiscard]] matrix_d operator*(const matrix_d& other) const {
+            if (columns_count != other.rows_count) {
                 throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
             }
 
-            matrix_d<T> result(rows_count, other.columns_count);
+            matrix_d result(rows_count, other.columns_count);
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < other.columns_count; ++ci) {
-                    T dot = static_cast<T>(operator()(ri, 0) * other(0, ci));
-                    for (size_t k = 1; k < columns_count; ++k) {
-                        dot = utility::add(dot, utility::multiply(operator()(ri, k), other(k, ci)));
+            if constexpr (std::is_floating_point_v<T>) {
+                result.gemm(T{ 1 }, *this, utility::Transposition::None, other, utility::Transposition::None, T{ 0 });
+            }
+            else {
+                for (index_type ri = 0; ri < rows_count; ++ri) {
+                    const auto left_row = row_span(ri);
+                    for (index_type ci = 0; ci < other.columns_count; ++ci) {
+                        T dot = static_cast<T>(left_row[0] * other.unchecked(0, ci));
+                        for (index_type k = 1; k < columns_count; ++k) {
+                            dot = utility::add(dot, utility::multiply(left_row[k], other.unchecked(k, ci)));
+                        }
+                        result.unchecked(ri, ci) = dot;
+                    }
+                }
+            }
+
+            return result;
+        }
+
+        // Strassen-Winograd product for square matrices: recursion stops at `crossover` and falls back to the
+        // regular kernel. Odd sizes are zero padded to base * 2^levels, the products of the top levels run in
+        // parallel and all temporaries come from a single preallocated workspace.
+        [[nodiscard]] matrix_d multiply_strassen(const matrix_d& other, index_type crossover = static_cast<index_type>(tuning::current().strassen_crossover),
+            std::size_t parallel_levels = 1) const requires std::is_floating_point_v<T> {
+            requires_square_matrix();
+            other.requires_square_matrix();
+
+            if (columns_count != other.rows_count) {
+                throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
+            }
+
+            crossover = std::max<index_type>(crossover, 1);
+            const std::size_t n = rows_count;
+            if (n <= crossover) {
+                return operator*(other);
+            }
+
+            MATRICES_PROFILE_SCOPE("strassen", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 2 * n * n * n);
+            MATRICES_PROFILE_COUNT(Bytes, 3 * n * n * sizeof(T));
+
+            const auto padded = strassen::padded_size(n, crossover);
+            const auto padding = padded != n ? 3 * padded * padded : 0;
+            const auto workspace_size = padding + strassen::workspace_size(padded, crossover, parallel_levels);
+            memory::arena_scope scratch;
+            strassen::workspace_arena<T> arena(scratch.allocate<T>(workspace_size), workspace_size);
+
+            const T* a = data.data();
+            const T* b = other.data.data();
+            T* c{ nullptr };
+
+            matrix_d result(rows_count, columns_count);
+
+            if (padding != 0) {
+                auto* padded_a = arena.take(padded * padded);
+                auto* padded_b = arena.take(padded * padded);
+                c = arena.take(padded * padded);
+
+                std::fill(padded_a, padded_a + padded * padded, T{ 0 });
+                std::fill(padded_b, padded_b + padded * padded, T{ 0 });
+                for (std::size_t ri = 0; ri < n; ++ri) {
+                    std::copy(a + ri * n, a + (ri + 1) * n, padded_a + ri * padded);
+                    std::copy(b + ri * n, b + (ri + 1) * n, padded_b + ri * padded);
+                }
+
+                a = padded_a;
+                b = padded_b;
+            }
+            else {
+                c = result.data.data();
+            }
+
+            // below the top levels the products already run concurrently, so the base kernel stays single threaded
+            auto base_multiply = [parallel_levels](std::size_t size, const T* left, std::size_t lda, const T* right, std::size_t ldb, T* out, std::size_t ldc) {
+                for (std::size_t ri = 0; ri < size; ++ri) {
+                    std::fill(out + ri * ldc, out + ri * ldc + size, T{ 0 });
+                }
+                gemm_kernel(utility::Transposition::None, utility::Transposition::None, size, size, size, T{ 1 }, left, lda, right, ldb, out, ldc, parallel_levels == 0);
+            };
+
+            strassen::multiply(padded, a, padded, b, padded, c, padded, crossover, parallel_levels, arena, base_multiply);
+
+            if (padding != 0) {
+                for (std::size_t ri = 0; ri < n; ++ri) {
+                    std::copy(c + ri * padded, c + ri * padded + n, result.data.data() + ri * n);
+                }
+            }
+
+            return result;
+        }
+
+        // this^exponent by repeated squaring, O(log exponent) products. The three working buffers are allocated
+        // once and swapped between the products. Integer elements are not checked for overflow.
+        [[nodiscard]] matrix_d power(std::uint64_t exponent) const requires std::is_arithmetic_v<T> {
+            requires_square_matrix();
+
+            matrix_d result(rows_count, columns_count);
+            if (exponent == 0) {
+                return result;
+            }
+
+            matrix_d base(rows_count, columns_count);
+            std::copy(std::begin(std::as_const(data)), std::end(std::as_const(data)), base.data.data());
+            matrix_d product(rows_count, columns_count);
+            bool identity{ true };
+
+            while (true) {
+                if ((exponent & 1) != 0) {
+                    if (identity) {
+                        std::copy(std::begin(std::as_const(base.data)), std::end(std::as_const(base.data)), result.data.data());
+                        identity = false;
+                    }
+                    else {
+                        product.gemm(T{ 1 }, result, utility::Transposition::None, base, utility::Transposition::None, T{ 0 });
+                        std::swap(result, product);
                     }
-                    result(ri, ci) = dot;
                 }
+
+                exponent >>= 1;
+                if (exponent == 0) {
+                    break;
+                }
+
+                product.gemm(T{ 1 }, base, utility::Transposition::None, base, utility::Transposition::None, T{ 0 });
+                std::swap(base, product);
             }
 
             return result;
         }
 
-        [[nodiscard]] matrix_d<T> multiply_with_threads(const matrix_d<T>& other) const {
-            if (rows_count != other.columns_count) {
+        // Computes rows [first_row, last_row) of this * other into the same rows of result, the other rows of
+        // result are left untouched. Lets callers consume finished row blocks while the rest is still computed.
+        void multiply_rows_into(const matrix_d& other, index_type first_row, index_type last_row, matrix_d& result) const requires std::is_arithmetic_v<T> {
+            if (columns_count != other.rows_count || result.rows_count != rows_count || result.columns_count != other.columns_count ||
+                first_row > last_row || last_row > rows_count) {
                 throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
             }
 
-            matrix_d<T> result(rows_count, other.columns_count);
+            multiply_into(last_row - first_row, other.columns_count, columns_count, data.data() + static_cast<std::size_t>(first_row) * columns_count,
+                columns_count, other.data.data(), other.columns_count, result.data.data() + static_cast<std::size_t>(first_row) * other.columns_count,
+                other.columns_count);
+        }
+
+        // c[m x n] = a[m x k] * b[k x n] on row-major buffers owned by the caller, e.g. one band of rows of a
+        // product in shared memory. Goes through the backend like the member products.
+        static void multiply_into(std::size_t m, std::size_t n, std::size_t k, const internal_type* a, std::size_t lda,
+            const internal_type* b, std::size_t ldb, internal_type* c, std::size_t ldc) requires std::is_arithmetic_v<T> {
+            if (m == 0 || n == 0) {
+                return;
+            }
+
+            MATRICES_PROFILE_SCOPE("gemm", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 2 * m * n * k);
+            MATRICES_PROFILE_COUNT(Bytes, (m * k + k * n + m * n) * sizeof(T));
+
+            if (k > 0 && backend::gemm(utility::Transposition::None, utility::Transposition::None, m, n, k, T{ 1 }, a, lda, b, ldb, T{ 0 }, c, ldc)) {
+                return;
+            }
+
+            for (std::size_t ri = 0; ri < m; ++ri) {
+                std::fill(c + ri * ldc, c + ri * ldc + n, T{ 0 });
+            }
+            gemm_kernel(utility::Transposition::None, utility::Transposition::None, m, n, k, T{ 1 }, a, lda, b, ldb, c, ldc);
+        }
+
+        // this = alpha * op(left) * op(right) + beta * this
+        // The transposed operands are never materialized. With beta equal to zero the previous contents are not read.
+        // Integer elements are not checked for overflow, use operator* for checked arithmetic.
+        void gemm(const internal_type& alpha, const matrix_d& left, utility::Transposition left_op,
+            const matrix_d& right, utility::Transposition right_op, const internal_type& beta) requires std::is_arithmetic_v<T> {
+            using utility::Transposition;
+
+            std::size_t m = left_op == Transposition::None ? left.rows_count : left.columns_count;
+            std::size_t k = left_op == Transposition::None ? left.columns_count : left.rows_count;
+            std::size_t right_rows = right_op == Transposition::None ? right.rows_count : right.columns_count;
+            std::size_t n = right_op == Transposition::None ? right.columns_count : right.rows_count;
+
+            if (k != right_rows || m != rows_count || n != columns_count) {
+                throw std::runtime_error("Gemm operation: The conditions of the operation are not met");
+            }
+
+            if (&left == this || &right == this) {
+                matrix_d result(*this);
+                result.gemm(alpha, left, left_op, right, right_op, beta);
+                *this = std::move(result);
+                return;
+            }
+
+            if (m == 0 || n == 0) {
+                return;
+            }
+
+            MATRICES_PROFILE_SCOPE("gemm", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 2 * m * n * k);
+            MATRICES_PROFILE_COUNT(Bytes, (m * k + k * n + m * n) * sizeof(T));
+
+            if (k > 0 && backend::gemm(left_op, right_op, m, n, k, alpha, left.data.data(), left.columns_count,
+                right.data.data(), right.columns_count, beta, data.data(), columns_count)) {
+                return;
+            }
+
+            scale(beta);
+            if (alpha == internal_type{ 0 } || k == 0) {
+                return;
+            }
+
+            gemm_kernel(left_op, right_op, m, n, k, alpha, left.data.data(), left.columns_count, right.data.data(), right.columns_count, data.data(), columns_count);
+        }
+
+        // result = alpha * op(this) * vector + beta * result
+        void gemv(const internal_type& alpha, utility::Transposition op, const std::vector<T>& vector,
+            const internal_type& beta, std::vector<T>& result) const requires std::is_arithmetic_v<T> {
+            using utility::Transposition;
+
+            std::size_t m = op == Transposition::None ? rows_count : columns_count;
+            std::size_t n = op == Transposition::None ? columns_count : rows_count;
+
+            if (vector.size() != n || result.size() != m) {
+                throw std::runtime_error("Gemv operation: The conditions of the operation are not met");
+            }
+
+            if (&vector == &result) {
+                std::vector<T> copy(vector);
+                gemv(alpha, op, copy, beta, result);
+                return;
+            }
+
+            if (beta == internal_type{ 0 }) {
+                std::fill(std::begin(result), std::end(result), internal_type{ 0 });
+            }
+            else if (beta != internal_type{ 1 }) {
+                for (auto& value : result) {
+                    value *= beta;
+                }
+            }
+
+            if (alpha == internal_type{ 0 }) {
+                return;
+            }
+
+            const auto* values = data.data();
+            auto grain = std::max<std::size_t>(1, tuning::current().parallel_gemm_threshold / std::max<std::size_t>(n, 1));
+
+            if (op == Transposition::None) {
+                numa::parallel_for(0, m, grain, [&](std::size_t first, std::size_t last) {
+                    for (auto ri = first; ri < last; ++ri) {
+                        const auto* row = values + ri * columns_count;
+
+                        internal_type dot{ 0 };
+                        for (std::size_t ci = 0; ci < n; ++ci) {
+                            dot += row[ci] * vector[ci];
+                        }
+                        result[ri] += alpha * dot;
+                    }
+                });
+            }
+            else {
+                // every worker owns a range of result entries and sweeps the rows over that range
+                utility::parallel_for(0, m, std::max<std::size_t>(grain, 64), [&](std::size_t first, std::size_t last) {
+                    for (std::size_t ri = 0; ri < n; ++ri) {
+                        auto factor = alpha * vector[ri];
+                        if (factor == internal_type{ 0 }) {
+                            continue;
+                        }
+
+                        const auto* row = values + ri * columns_count;
+                        for (auto ci = first; ci < last; ++ci) {
+                            result[ci] += factor * row[ci];
+                        }
+                    }
+                });
+            }
+        }
+
+        [[nodiscard]] matrix_d multiply_with_threads(const matrix_d& other) const {
+            if (columns_count != other.rows_count) {
+                throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
+            }
+
+            matrix_d result(rows_count, other.columns_count);
+            // taken before the threads start, so they never check whether the elements are shared
+            auto* values = result.begin();
 
             auto multiply_row_adn_col = [&](int row, int col) {
                 T sum = 0;
                 for (index_type k = 0; k < columns_count; ++k) {
-                    sum += operator()(row, k) * other(k, col);
+                    sum += unchecked(row, k) * other.unchecked(k, col);
                 }
-                result(row, col) = sum;
+                values[static_cast<std::size_t>(row) * other.columns_count + col] = sum;
             };
 
             std::vector<std::thread> threads;
@@ -212,141 +802,406 @@ namespace matrices {
         }
         
 
-        [[nodiscard]] matrix_d<T> operator+(const matrix_d<T>& other) const {
-            requires_same_size_for_matrices(other);
+        template<typename Accumulator = utility::accumulator_t<T>> requires utility::widening_accumulator<T, Accumulator>
+        [[nodiscard]] matrix_d<Accumulator> multiply_mixed(const matrix_d& other) const {
+            if (columns_count != other.rows_count) {
+                throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
+            }
 
-            matrix_d<T> result(rows_count, columns_count);
+            MATRICES_PROFILE_SCOPE("gemm_mixed", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 2 * static_cast<std::size_t>(rows_count) * columns_count * other.columns_count);
+            MATRICES_PROFILE_COUNT(Bytes, (data.size() + other.data.size()) * sizeof(T) + static_cast<std::size_t>(rows_count) * other.columns_count * sizeof(Accumulator));
+
+            matrix_d<Accumulator> result(rows_count, other.columns_count);
+            std::fill(std::begin(result.data), std::end(result.data), Accumulator{ 0 });
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::add(operator()(ri, ci), other(ri, ci));
+                auto* result_row = result.data.data() + static_cast<std::size_t>(ri) * other.columns_count;
+                const auto* left_row = data.data() + static_cast<std::size_t>(ri) * columns_count;
+
+                for (index_type k = 0; k < columns_count; ++k) {
+                    auto left_value = utility::convert<Accumulator>(left_row[k]);
+                    if (left_value == Accumulator{ 0 }) {
+                        continue;
+                    }
+
+                    const auto* right_row = other.data.data() + static_cast<std::size_t>(k) * other.columns_count;
+                    for (index_type ci = 0; ci < other.columns_count; ++ci) {
+                        result_row[ci] += left_value * utility::convert<Accumulator>(right_row[ci]);
+                    }
                 }
             }
 
             return result;
         }
 
-        [[nodiscard]] matrix_d<T> operator-(const matrix_d<T>& other) const {
-            requires_same_size_for_matrices(other);
+        template<typename Accumulator = utility::accumulator_t<T>> requires utility::widening_accumulator<T, Accumulator>
+        [[nodiscard]] std::vector<Accumulator> multiply_vector_mixed(const std::vector<T>& vector) const {
+            if (columns_count != vector.size()) {
+                throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
+            }
 
-            matrix_d<T> result(rows_count, columns_count);
+            std::vector<Accumulator> result(rows_count, Accumulator{ 0 });
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
+                const auto* row = data.data() + static_cast<std::size_t>(ri) * columns_count;
+
+                Accumulator dot{ 0 };
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::subtract(operator()(ri, ci), other(ri, ci));
+                    dot += utility::convert<Accumulator>(row[ci]) * utility::convert<Accumulator>(vector[ci]);
                 }
+                result[ri] = dot;
             }
 
             return result;
         }
 
-        [[nodiscard]] matrix_d<T> operator+(const T& value) const {
-            matrix_d<T> result(rows_count, columns_count);
+        template<typename U> requires utility::Element<U>
+        [[nodiscard]] matrix_d<U> cast() const {
+            matrix_d<U> result(rows_count, columns_count);
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::add(operator()(ri, ci), value);
-                }
-            }
+            std::transform(std::begin(data), std::end(data), std::begin(result.data),
+                [](const internal_type& value) { return utility::convert<U>(value); });
 
             return result;
         }
 
-        [[nodiscard]] matrix_d<T> operator-(const T& value) const {
-            matrix_d<T> result(rows_count, columns_count);
+        // this(ri, ci) = function(inputs(ri, ci)...) in one fused pass, without temporaries. Inputs may be any
+        // matrix_d of this shape, row vectors (1 x columns), column vectors (rows x 1) or 1 x 1 matrices, which
+        // are broadcast. This matrix may be one of the inputs.
+        template<typename Function, typename... Inputs>
+        void zip(const Function& function, const Inputs&... inputs) {
+            auto* destination = data.data();
+            elementwise::apply(destination, rows_count, columns_count, function,
+                elementwise::broadcast(inputs.data.data(), inputs.rows_count, inputs.columns_count, rows_count, columns_count)...);
+        }
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::subtract(operator()(ri, ci), value);
-                }
-            }
+        template<typename Function>
+        [[nodiscard]] matrix_d map(const Function& function) const {
+            matrix_d result(rows_count, columns_count);
+            result.zip(function, *this);
+            return result;
+        }
+
+        template<typename Function>
+        void map_in_place(const Function& function) {
+            zip(function, *this);
+        }
 
+        // Elementwise product, `other` may be broadcast.
+        [[nodiscard]] matrix_d hadamard(const matrix_d& other) const requires std::is_arithmetic_v<T> {
+            matrix_d result(rows_count, columns_count);
+            result.zip([](const internal_type& left, const internal_type& right) { return utility::multiply(left, right); }, *this, other);
             return result;
         }
 
-        [[nodiscard]] matrix_d<T> operator*(const T& value) const {
-            matrix_d<T> result(rows_count, columns_count);
+        [[nodiscard]] matrix_d operator+(const matrix_d& other) const {
+            requires_same_size_for_matrices(other);
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::multiply(operator()(ri, ci), value);
-                }
-            }
+            matrix_d result(rows_count, columns_count);
+            result.zip([](const internal_type& left, const internal_type& right) { return utility::add(left, right); }, *this, other);
+            return result;
+        }
 
+        [[nodiscard]] matrix_d operator-(const matrix_d& other) const {
+            requires_same_size_for_matrices(other);
+
+            matrix_d result(rows_count, columns_count);
+            result.zip([](const internal_type& left, const internal_type& right) { return utility::subtract(left, right); }, *this, other);
             return result;
         }
 
+        [[nodiscard]] matrix_d operator+(const T& value) const {
+            return map([value](const internal_type& element) { return utility::add(element, value); });
+        }
+
+        [[nodiscard]] matrix_d operator-(const T& value) const {
+            return map([value](const internal_type& element) { return utility::subtract(element, value); });
+        }
+
+        [[nodiscard]] matrix_d operator*(const T& value) const {
+            return map([value](const internal_type& element) { return utility::multiply(element, value); });
+        }
+
         [[nodiscard]] matrix_d<double> inverse() const  {
             requires_square_matrix();
 
-            matrix_d<double> augmented_matrix(rows_count, columns_count * 2);
+            MATRICES_PROFILE_SCOPE("inverse", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 2 * static_cast<std::size_t>(rows_count) * rows_count * rows_count);
+            MATRICES_PROFILE_COUNT(Bytes, 2 * data.size() * sizeof(double));
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < columns_count; ++ci) {
-                    augmented_matrix(ri, ci) = operator()(ri, ci);
+            if (backend::use_external(rows_count)) {
+                auto result = cast<double>();
+                if (backend::inverse(result.data.data(), rows_count)) {
+                    return result;
                 }
-                augmented_matrix(ri, ri + rows_count) = 1.0;
             }
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                if (augmented_matrix(ri, ri) == 0.0) {
-                    throw std::runtime_error("Inverse matrix operation: Invertible matrix");
+            // in place Gauss-Jordan with partial pivoting, the same algorithm with and without a memory budget
+            auto result = cast<double>();
+            factorization::invert(result.data.data(), rows_count);
+            return result;
+        }
+
+        // Solves this * x = rhs by Gaussian elimination with partial pivoting.
+        [[nodiscard]] matrix_d<double> solve(const matrix_d& rhs) const {
+            requires_square_matrix();
+
+            if (rhs.rows_count != rows_count) {
+                throw std::runtime_error("Solve operation: The conditions of the operation are not met");
+            }
+
+            const std::size_t n = rows_count;
+            const std::size_t nrhs = rhs.columns_count;
+
+            MATRICES_PROFILE_SCOPE("solve", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 2 * n * n * n / 3 + 2 * n * n * nrhs);
+            MATRICES_PROFILE_COUNT(Bytes, (n * n + 2 * n * nrhs) * sizeof(double));
+
+            memory::arena_scope scratch;
+            auto* a = scratch.allocate<double>(n * n);
+            std::transform(std::begin(data), std::end(data), a, [](const internal_type& value) { return utility::convert<double>(value); });
+
+            auto result = rhs.template cast<double>();
+            auto* b = result.data.data();
+
+            if (backend::solve(a, n, b, nrhs)) {
+                return result;
+            }
+
+            for (std::size_t col = 0; col < n; ++col) {
+                auto pivot_row = col;
+                for (auto ri = col + 1; ri < n; ++ri) {
+                    if (std::abs(a[ri * n + col]) > std::abs(a[pivot_row * n + col])) {
+                        pivot_row = ri;
+                    }
                 }
 
-                double pivot = augmented_matrix(ri, ri);
-                if (pivot == 0.0) {
-                    throw std::runtime_error("Inverse matrix operation: can't calculate matrix");
+                if (a[pivot_row * n + col] == 0.0) {
+                    throw std::runtime_error("Solve operation: The matrix is singular");
                 }
 
-                for (index_type ci = 0; ci < augmented_matrix.get_columns_count(); ++ci) {
-                    augmented_matrix(ri, ci) = augmented_matrix(ri, ci) / pivot;
+                if (pivot_row != col) {
+                    std::swap_ranges(a + col * n, a + (col + 1) * n, a + pivot_row * n);
+                    std::swap_ranges(b + col * nrhs, b + (col + 1) * nrhs, b + pivot_row * nrhs);
                 }
 
-                for (index_type k = 0; k < rows_count; ++k) {
-                    if (k != ri) {
-                        double factor = augmented_matrix(k, ri);
+                auto pivot = a[col * n + col];
+                for (auto ri = col + 1; ri < n; ++ri) {
+                    auto factor = a[ri * n + col] / pivot;
+                    if (factor == 0.0) {
+                        continue;
+                    }
 
-                        for (index_type ci = 0; ci < augmented_matrix.get_columns_count(); ++ci) {
-                            augmented_matrix(k, ci) = augmented_matrix(k, ci) - factor * augmented_matrix(ri, ci);
-                        }
+                    for (auto ci = col; ci < n; ++ci) {
+                        a[ri * n + ci] -= factor * a[col * n + ci];
+                    }
+                    for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                        b[ri * nrhs + ci] -= factor * b[col * nrhs + ci];
                     }
                 }
             }
 
-            matrix_d<double> result(rows_count, columns_count);
+            for (auto ri = n; ri-- > 0;) {
+                for (auto k = ri + 1; k < n; ++k) {
+                    auto factor = a[ri * n + k];
+                    for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                        b[ri * nrhs + ci] -= factor * b[k * nrhs + ci];
+                    }
+                }
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = augmented_matrix(ri, ci + columns_count);
+                auto pivot = a[ri * n + ri];
+                for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                    b[ri * nrhs + ci] /= pivot;
                 }
             }
 
             return result;
         }
 
-        [[nodiscard]] matrix_d<T> submatrix(const index_type& sub_rows, const index_type& sub_cols, const index_type& start_row, const index_type& start_col) const {
+        // Lower triangular L with this = L * L^T, for symmetric positive definite matrices. Only the lower
+        // triangle is read.
+        [[nodiscard]] matrix_d<double> cholesky() const {
+            requires_square_matrix();
+
+            MATRICES_PROFILE_SCOPE("cholesky", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, static_cast<std::size_t>(rows_count) * rows_count * rows_count / 3);
+            MATRICES_PROFILE_COUNT(Bytes, 2 * data.size() * sizeof(double));
+
+            auto result = cast<double>();
+            factorization::cholesky(result.data.data(), rows_count);
+            return result;
+        }
+
+        // Solves this * x = rhs for a symmetric positive definite matrix through its Cholesky factor, half the
+        // flops of the LU based solve().
+        [[nodiscard]] matrix_d<double> cholesky_solve(const matrix_d& rhs) const {
+            requires_square_matrix();
+
+            if (rhs.rows_count != rows_count) {
+                throw std::runtime_error("Cholesky solve operation: The conditions of the operation are not met");
+            }
+
+            const auto factor = cholesky();
+            auto result = rhs.template cast<double>();
+            factorization::cholesky_solve(factor.data.data(), rows_count, result.data.data(), result.columns_count);
+            return result;
+        }
+
+        // Thin QR decomposition of a rows x columns matrix (rows >= columns): Q is rows x columns with
+        // orthonormal columns, R is columns x columns upper triangular.
+        [[nodiscard]] std::pair<matrix_d<double>, matrix_d<double>> qr() const {
+            const std::size_t m = rows_count;
+            const std::size_t n = columns_count;
+
+            MATRICES_PROFILE_SCOPE("qr", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 4 * m * n * n - std::min(m, n) * n * n * 4 / 3);
+            MATRICES_PROFILE_COUNT(Bytes, (2 * m * n + n * n) * sizeof(double));
+
+            auto compact = cast<double>();
+            memory::arena_scope scratch;
+            auto* tau = scratch.allocate<double>(n);
+            factorization::householder_qr decomposition(compact.data.data(), m, n, tau);
+
+            matrix_d<double> r(columns_count, columns_count);
+            for (std::size_t ri = 0; ri < n; ++ri) {
+                for (std::size_t ci = 0; ci < n; ++ci) {
+                    r.data[ri * n + ci] = ci >= ri ? compact.data[ri * n + ci] : 0.0;
+                }
+            }
+
+            // the constructor fills the leading columns of the identity
+            matrix_d<double> q(rows_count, columns_count);
+            decomposition.apply_q(q.data.data(), n);
+
+            return { std::move(q), std::move(r) };
+        }
+
+        // Minimizes ||this * x - rhs|| column by column with a Householder QR, for full column rank matrices
+        // with at least as many rows as columns. Returns the columns x rhs.columns solution.
+        [[nodiscard]] matrix_d<double> least_squares(const matrix_d& rhs) const {
+            if (rhs.rows_count != rows_count) {
+                throw std::runtime_error("Least squares operation: The conditions of the operation are not met");
+            }
+
+            const std::size_t m = rows_count;
+            const std::size_t n = columns_count;
+            const std::size_t nrhs = rhs.columns_count;
+
+            MATRICES_PROFILE_SCOPE("least_squares", "kernel");
+            MATRICES_PROFILE_COUNT(Flops, 2 * m * n * n - std::min(m, n) * n * n * 2 / 3 + 4 * m * n * nrhs);
+            MATRICES_PROFILE_COUNT(Bytes, (m * n + 2 * m * nrhs) * sizeof(double));
+
+            auto compact = cast<double>();
+            auto transformed = rhs.template cast<double>();
+
+            memory::arena_scope scratch;
+            auto* tau = scratch.allocate<double>(n);
+            factorization::householder_qr decomposition(compact.data.data(), m, n, tau);
+            decomposition.apply_qt(transformed.data.data(), nrhs);
+            decomposition.solve_r(transformed.data.data(), nrhs);
+
+            matrix_d<double> result(columns_count, rhs.columns_count);
+            std::copy(transformed.data.data(), transformed.data.data() + n * nrhs, result.data.data());
+            return result;
+        }
+
+        [[nodiscard]] double sum() const {
+            return reduction::sum(data.data(), data.size());
+        }
+
+        [[nodiscard]] double frobenius_norm() const {
+            return reduction::norm(data.data(), data.size());
+        }
+
+        [[nodiscard]] double trace() const {
+            requires_square_matrix();
+            return reduction::sum(data.data(), rows_count, static_cast<std::size_t>(columns_count) + 1);
+        }
+
+        [[nodiscard]] internal_type min() const requires std::is_arithmetic_v<T> {
+            return reduction::min(data.data(), data.size());
+        }
+
+        [[nodiscard]] internal_type max() const requires std::is_arithmetic_v<T> {
+            return reduction::max(data.data(), data.size());
+        }
+
+        // Frobenius inner product, the sum of the elementwise products.
+        [[nodiscard]] double dot(const matrix_d& other) const {
+            requires_same_size_for_matrices(other);
+            return reduction::dot(data.data(), other.data.data(), data.size());
+        }
+
+        // One value per row (rows_count values) or per column (columns_count values).
+        [[nodiscard]] std::vector<double> reduce_rows(utility::Reduction kind) const requires std::is_arithmetic_v<T> {
+            return reduction::rows(data.data(), rows_count, columns_count, columns_count, kind);
+        }
+
+        [[nodiscard]] std::vector<double> reduce_columns(utility::Reduction kind) const requires std::is_arithmetic_v<T> {
+            return reduction::columns(data.data(), rows_count, columns_count, columns_count, kind);
+        }
+
+        [[nodiscard]] matrix_d submatrix(const index_type& sub_rows, const index_type& sub_cols, const index_type& start_row, const index_type& start_col) const {
             requires_take_submatrix(sub_rows, sub_cols, start_row, start_col);
 
-            matrix_d<T> result(sub_rows, sub_cols);
+            matrix_d result(sub_rows, sub_cols);
 
             for (index_type ri = 0; ri < sub_rows; ++ri) {
-                for (index_type ci = 0; ci < sub_cols; ++ci) {
-                    result(ri, ci) = operator()(start_row + ri, start_col + ci);
-                }
+                const auto source = row_span(start_row + ri).subspan(start_col, sub_cols);
+                std::copy(std::begin(source), std::end(source), std::begin(result.row_span(ri)));
             }
             return result;
         }
 
-        [[nodiscard]] matrix_d<T> transpose() const {
-            matrix_d<T> result(rows_count, columns_count);
+        [[nodiscard]] matrix_d transpose() const {
+            MATRICES_PROFILE_SCOPE("transpose", "kernel");
+            MATRICES_PROFILE_COUNT(Bytes, 2 * data.size() * sizeof(T));
 
-            for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ci, ri) = operator()(ri, ci);
+            const auto& tuned = tuning::current();
+            const auto transpose_block = tuned.transpose_block;
+
+            matrix_d result(columns_count, rows_count);
+
+            const auto* source = data.data();
+            auto* destination = result.data.data();
+            auto block_rows = (static_cast<std::size_t>(rows_count) + transpose_block - 1) / transpose_block;
+
+            auto transpose_block_rows = [&](std::size_t first_block, std::size_t last_block) {
+                for (auto block = first_block; block < last_block; ++block) {
+                    auto row_first = static_cast<index_type>(block * transpose_block);
+                    auto row_last = std::min<index_type>(row_first + transpose_block, rows_count);
+
+                    for (index_type col_first = 0; col_first < columns_count; col_first += transpose_block) {
+                        auto col_last = std::min<index_type>(col_first + transpose_block, columns_count);
+                        transpose_tile(source, columns_count, destination, rows_count, row_first, row_last, col_first, col_last);
+                    }
                 }
+            };
+
+            if (data.size() < tuned.parallel_transpose_threshold) {
+                transpose_block_rows(0, block_rows);
+            }
+            else {
+                utility::parallel_for(0, block_rows, 1, transpose_block_rows);
             }
 
             return result;
         }
+
+        // Transposes the matrix without a second full size buffer. Square matrices swap tiles across the
+        // diagonal in parallel, rectangular ones are permuted by following the cycles of the index mapping.
+        void transpose_in_place() {
+            MATRICES_PROFILE_SCOPE("transpose", "kernel");
+            MATRICES_PROFILE_COUNT(Bytes, 2 * data.size() * sizeof(T));
+
+            if (rows_count == columns_count) {
+                transpose_square_in_place();
+            }
+            else {
+                transpose_rectangular_in_place();
+                std::swap(rows_count, columns_count);
+            }
+        }
     };
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <cstddef>
+#include <stdexcept>
+
+#include "numa.h"
+#include "tuning.h"
+
+// Fused elementwise kernels: destination(ri, ci) = function(input_0(ri, ci), input_1(ri, ci), ...) in one pass
+// without temporaries. Inputs follow the broadcasting rules of the destination shape: a full matrix, a row
+// vector (1 x columns, repeated for every row), a column vector (rows x 1, repeated for every column) or a
+// single element.
+namespace matrices::elementwise {
+    [[nodiscard]] inline std::size_t parallel_threshold() {
+        return tuning::current().elementwise_parallel_threshold;
+    }
+
+    template<typename T>
+    struct operand {
+        const T* values;
+        // zero along a broadcast dimension
+        std::size_t row_stride;
+        std::size_t column_stride;
+
+        [[nodiscard]] const T* row(std::size_t index) const {
+            return values + index * row_stride;
+        }
+    };
+
+    template<typename T>
+    [[nodiscard]] operand<T> broadcast(const T* values, std::size_t rows, std::size_t columns, std::size_t destination_rows, std::size_t destination_columns) {
+        if ((rows != destination_rows && rows != 1) || (columns != destination_columns && columns != 1)) {
+            throw std::runtime_error("Elementwise operation: the operand can not be broadcast to the destination");
+        }
+
+        return { values, rows == 1 ? std::size_t{ 0 } : columns, columns == 1 ? std::size_t{ 0 } : std::size_t{ 1 } };
+    }
+
+    // Rows are processed in parallel for large destinations. When no input is broadcast along the columns
+    // the inner loop runs over plain contiguous pointers and is vectorized by the compiler.
+    template<typename Destination, typename Function, typename... Inputs>
+    void apply(Destination* destination, std::size_t rows, std::size_t columns, const Function& function, const operand<Inputs>&... inputs) {
+        const bool contiguous = ((inputs.column_stride == 1) && ...);
+
+        auto process_rows = [&](std::size_t first, std::size_t last) {
+            for (auto ri = first; ri < last; ++ri) {
+                auto* out = destination + ri * columns;
+
+                if (contiguous) {
+                    [&](const auto*... rows_values) {
+                        for (std::size_t ci = 0; ci < columns; ++ci) {
+                            out[ci] = static_cast<Destination>(function(rows_values[ci]...));
+                        }
+                    }(inputs.row(ri)...);
+                }
+                else {
+                    [&](const auto*... rows_values) {
+                        for (std::size_t ci = 0; ci < columns; ++ci) {
+                            out[ci] = static_cast<Destination>(function(rows_values[ci * inputs.column_stride]...));
+                        }
+                    }(inputs.row(ri)...);
+                }
+            }
+        };
+
+        if (rows * columns < parallel_threshold()) {
+            process_rows(0, rows);
+        }
+        else {
+            numa::parallel_for(0, rows, std::max<std::size_t>(1, parallel_threshold() / 4 / std::max<std::size_t>(columns, 1)), process_rows);
+        }
+    }
+}
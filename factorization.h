@@ -0,0 +1,491 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+
+#include "parallel.h"
+#include "memory.h"
+#include "tuning.h"
+
+// Blocked factorizations of row-major double matrices. The panels are factored sequentially, the trailing
+// updates (which hold almost all of the flops) are split between threads.
+namespace matrices::factorization {
+    inline constexpr std::size_t block = 64;
+    // trailing updates with fewer multiply-adds than this stay on the calling thread
+    [[nodiscard]] inline std::size_t parallel_threshold() {
+        return tuning::current().factorization_parallel_threshold;
+    }
+
+    template<typename Function>
+    void for_chunks(std::size_t first, std::size_t last, std::size_t grain, std::size_t work, Function&& function) {
+        if (work < parallel_threshold()) {
+            function(first, last);
+        }
+        else {
+            utility::parallel_for(first, last, grain, function);
+        }
+    }
+
+    // In place lower Cholesky factor A = L L^T of the n x n SPD matrix a, the strict upper triangle is zeroed.
+    inline void cholesky(double* a, std::size_t n) {
+        for (std::size_t k0 = 0; k0 < n; k0 += block) {
+            const auto k1 = std::min(k0 + block, n);
+
+            // diagonal block, the earlier panels are already subtracted by the trailing updates
+            for (auto j = k0; j < k1; ++j) {
+                auto* row_j = a + j * n;
+                auto diagonal = row_j[j];
+                for (auto p = k0; p < j; ++p) {
+                    diagonal -= row_j[p] * row_j[p];
+                }
+
+                if (!(diagonal > 0.0) || !std::isfinite(diagonal)) {
+                    throw std::runtime_error("Cholesky decomposition: the matrix is not positive definite");
+                }
+                row_j[j] = std::sqrt(diagonal);
+
+                for (auto i = j + 1; i < k1; ++i) {
+                    auto* row_i = a + i * n;
+                    auto value = row_i[j];
+                    for (auto p = k0; p < j; ++p) {
+                        value -= row_i[p] * row_j[p];
+                    }
+                    row_i[j] = value / row_j[j];
+                }
+            }
+
+            // panel below the diagonal block: L21 = A21 L11^-T, then A22 -= L21 L21^T (lower triangle only)
+            const auto width = k1 - k0;
+            const auto rest = n - k1;
+            for_chunks(k1, n, 16, rest * rest * width / 2, [&](std::size_t first, std::size_t last) {
+                for (auto i = first; i < last; ++i) {
+                    auto* row_i = a + i * n;
+                    for (auto j = k0; j < k1; ++j) {
+                        const auto* row_j = a + j * n;
+                        auto value = row_i[j];
+                        for (auto p = k0; p < j; ++p) {
+                            value -= row_i[p] * row_j[p];
+                        }
+                        row_i[j] = value / row_j[j];
+                    }
+                }
+            });
+
+            for_chunks(k1, n, 8, rest * rest * width / 2, [&](std::size_t first, std::size_t last) {
+                for (auto i = first; i < last; ++i) {
+                    auto* row_i = a + i * n;
+                    for (auto j = k1; j <= i; ++j) {
+                        const auto* row_j = a + j * n;
+                        double sum{ 0.0 };
+                        for (auto p = k0; p < k1; ++p) {
+                            sum += row_i[p] * row_j[p];
+                        }
+                        row_i[j] -= sum;
+                    }
+                }
+            });
+        }
+
+        for (std::size_t i = 0; i < n; ++i) {
+            std::fill(a + i * n + i + 1, a + (i + 1) * n, 0.0);
+        }
+    }
+
+    // Solves L L^T X = B in place for the n x nrhs right hand sides b.
+    inline void cholesky_solve(const double* l, std::size_t n, double* b, std::size_t nrhs) {
+        for (std::size_t i = 0; i < n; ++i) {
+            auto* row = b + i * nrhs;
+            for (std::size_t p = 0; p < i; ++p) {
+                const auto factor = l[i * n + p];
+                for (std::size_t c = 0; c < nrhs; ++c) {
+                    row[c] -= factor * b[p * nrhs + c];
+                }
+            }
+            for (std::size_t c = 0; c < nrhs; ++c) {
+                row[c] /= l[i * n + i];
+            }
+        }
+
+        for (auto i = n; i-- > 0;) {
+            auto* row = b + i * nrhs;
+            for (auto p = i + 1; p < n; ++p) {
+                const auto factor = l[p * n + i];
+                for (std::size_t c = 0; c < nrhs; ++c) {
+                    row[c] -= factor * b[p * nrhs + c];
+                }
+            }
+            for (std::size_t c = 0; c < nrhs; ++c) {
+                row[c] /= l[i * n + i];
+            }
+        }
+    }
+
+    // In place Gauss-Jordan inverse of the n x n matrix a with partial pivoting, needs no augmented copy. The
+    // row swaps become column swaps of the inverse, undone in reverse order at the end.
+    inline void invert(double* a, std::size_t n) {
+        memory::arena_scope scratch;
+        auto* pivots = scratch.allocate<std::size_t>(n);
+
+        for (std::size_t k = 0; k < n; ++k) {
+            auto pivot_row = k;
+            for (auto ri = k + 1; ri < n; ++ri) {
+                if (std::abs(a[ri * n + k]) > std::abs(a[pivot_row * n + k])) {
+                    pivot_row = ri;
+                }
+            }
+
+            if (a[pivot_row * n + k] == 0.0) {
+                throw std::runtime_error("Inverse matrix operation: Invertible matrix");
+            }
+
+            pivots[k] = pivot_row;
+            if (pivot_row != k) {
+                std::swap_ranges(a + k * n, a + (k + 1) * n, a + pivot_row * n);
+            }
+
+            auto* row_k = a + k * n;
+            auto pivot = row_k[k];
+            row_k[k] = 1.0;
+            for (std::size_t ci = 0; ci < n; ++ci) {
+                row_k[ci] /= pivot;
+            }
+
+            for_chunks(0, n, 64, n * n, [&](std::size_t first, std::size_t last) {
+                for (auto ri = first; ri < last; ++ri) {
+                    if (ri == k) {
+                        continue;
+                    }
+
+                    auto* row = a + ri * n;
+                    auto factor = row[k];
+                    if (factor == 0.0) {
+                        continue;
+                    }
+
+                    row[k] = 0.0;
+                    for (std::size_t ci = 0; ci < n; ++ci) {
+                        row[ci] -= factor * row_k[ci];
+                    }
+                }
+            });
+        }
+
+        for (auto k = n; k-- > 0;) {
+            if (pivots[k] != k) {
+                for (std::size_t ri = 0; ri < n; ++ri) {
+                    std::swap(a[ri * n + k], a[ri * n + pivots[k]]);
+                }
+            }
+        }
+    }
+
+    // In place LU factorization with partial pivoting, P a = L U: U is left in the upper triangle and the unit
+    // lower triangle of L below it. Row k was swapped with row pivots[k] at step k.
+    inline void lu(double* a, std::size_t n, std::size_t* pivots) {
+        for (std::size_t k = 0; k < n; ++k) {
+            auto pivot_row = k;
+            for (auto ri = k + 1; ri < n; ++ri) {
+                if (std::abs(a[ri * n + k]) > std::abs(a[pivot_row * n + k])) {
+                    pivot_row = ri;
+                }
+            }
+
+            if (a[pivot_row * n + k] == 0.0) {
+                throw std::runtime_error("LU decomposition: The matrix is singular");
+            }
+
+            pivots[k] = pivot_row;
+            if (pivot_row != k) {
+                std::swap_ranges(a + k * n, a + (k + 1) * n, a + pivot_row * n);
+            }
+
+            const auto* row_k = a + k * n;
+            const auto pivot = row_k[k];
+            for_chunks(k + 1, n, 64, (n - k) * (n - k), [&](std::size_t first, std::size_t last) {
+                for (auto ri = first; ri < last; ++ri) {
+                    auto* row = a + ri * n;
+                    auto factor = row[k] / pivot;
+                    row[k] = factor;
+                    if (factor == 0.0) {
+                        continue;
+                    }
+
+                    for (auto ci = k + 1; ci < n; ++ci) {
+                        row[ci] -= factor * row_k[ci];
+                    }
+                }
+            });
+        }
+    }
+
+    // Solves a x = b in place for the n x nrhs right hand sides b (row stride ldb) with the factors of lu().
+    inline void lu_solve(const double* lu, const std::size_t* pivots, std::size_t n, double* b, std::size_t nrhs, std::size_t ldb) {
+        for (std::size_t k = 0; k < n; ++k) {
+            if (pivots[k] != k) {
+                std::swap_ranges(b + k * ldb, b + k * ldb + nrhs, b + pivots[k] * ldb);
+            }
+        }
+
+        for (std::size_t ri = 1; ri < n; ++ri) {
+            auto* row = b + ri * ldb;
+            for (std::size_t k = 0; k < ri; ++k) {
+                auto factor = lu[ri * n + k];
+                if (factor == 0.0) {
+                    continue;
+                }
+
+                const auto* source = b + k * ldb;
+                for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                    row[ci] -= factor * source[ci];
+                }
+            }
+        }
+
+        for (auto ri = n; ri-- > 0;) {
+            auto* row = b + ri * ldb;
+            for (auto k = ri + 1; k < n; ++k) {
+                auto factor = lu[ri * n + k];
+                if (factor == 0.0) {
+                    continue;
+                }
+
+                const auto* source = b + k * ldb;
+                for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                    row[ci] -= factor * source[ci];
+                }
+            }
+
+            const auto diagonal = lu[ri * n + ri];
+            for (std::size_t ci = 0; ci < nrhs; ++ci) {
+                row[ci] /= diagonal;
+            }
+        }
+    }
+
+    // Compact Householder QR of the m x n matrix a (m >= n): R is left in the upper triangle, the reflector
+    // vectors v_j (with an implicit leading one) below the diagonal and their scalars in tau[0, n).
+    // Q = H_0 H_1 ... H_(n-1), H_j = I - tau_j v_j v_j^T.
+    class householder_qr final {
+        double* a;
+        std::size_t m;
+        std::size_t n;
+        double* tau;
+
+        // element `row` of reflector `column`
+        [[nodiscard]] double reflector(std::size_t row, std::size_t column) const {
+            if (row < column) {
+                return 0.0;
+            }
+            return row == column ? 1.0 : a[row * n + column];
+        }
+
+        // Upper triangular T of the panel [k0, k1) with H_k0 ... H_(k1-1) = I - V T V^T (forward, columnwise).
+        void triangular_factor(std::size_t k0, std::size_t k1, double* t) const {
+            const auto width = k1 - k0;
+            std::fill(t, t + width * width, 0.0);
+
+            for (std::size_t i = 0; i < width; ++i) {
+                const auto column = k0 + i;
+                t[i * width + i] = tau[column];
+
+                // z = V(:, 0:i)^T v_i
+                double* z = t + i;
+                for (std::size_t p = 0; p < i; ++p) {
+                    double sum{ 0.0 };
+                    for (auto r = column; r < m; ++r) {
+                        sum += reflector(r, k0 + p) * reflector(r, column);
+                    }
+                    z[p * width] = sum;
+                }
+
+                // T(0:i, i) = -tau_i T(0:i, 0:i) z, T is upper triangular so rows are processed top down
+                for (std::size_t r = 0; r < i; ++r) {
+                    double sum{ 0.0 };
+                    for (auto p = r; p < i; ++p) {
+                        sum += t[r * width + p] * z[p * width];
+                    }
+                    z[r * width] = -tau[column] * sum;
+                }
+            }
+        }
+
+        // C = (I - V op(T) V^T) C for rows [k0, m) of the matrix c and its columns [first, last);
+        // op(T) = T^T applies Q^T of the panel, op(T) = T applies Q.
+        void apply_block(std::size_t k0, std::size_t k1, const double* t, bool transposed, double* c, std::size_t ldc,
+            std::size_t first, std::size_t last) const {
+            const auto width = k1 - k0;
+            const auto columns = last - first;
+            if (columns == 0) {
+                return;
+            }
+
+            memory::arena_scope scratch;
+            auto* w = scratch.allocate<double>(width * columns);
+            auto* tw = scratch.allocate<double>(width * columns);
+
+            // W = V^T C
+            std::fill(w, w + width * columns, 0.0);
+            for (auto r = k0; r < m; ++r) {
+                const auto* c_row = c + r * ldc + first;
+                for (std::size_t p = 0; p < width && k0 + p <= r; ++p) {
+                    const auto v = reflector(r, k0 + p);
+                    auto* w_row = w + p * columns;
+                    for (std::size_t col = 0; col < columns; ++col) {
+                        w_row[col] += v * c_row[col];
+                    }
+                }
+            }
+
+            // W = op(T) W
+            for (std::size_t i = 0; i < width; ++i) {
+                auto* out = tw + i * columns;
+                std::fill(out, out + columns, 0.0);
+                for (std::size_t p = 0; p < width; ++p) {
+                    const auto factor = transposed ? (p <= i ? t[p * width + i] : 0.0) : (p >= i ? t[i * width + p] : 0.0);
+                    if (factor == 0.0) {
+                        continue;
+                    }
+                    const auto* w_row = w + p * columns;
+                    for (std::size_t col = 0; col < columns; ++col) {
+                        out[col] += factor * w_row[col];
+                    }
+                }
+            }
+
+            // C -= V W
+            for (auto r = k0; r < m; ++r) {
+                auto* c_row = c + r * ldc + first;
+                for (std::size_t p = 0; p < width && k0 + p <= r; ++p) {
+                    const auto v = reflector(r, k0 + p);
+                    const auto* w_row = tw + p * columns;
+                    for (std::size_t col = 0; col < columns; ++col) {
+                        c_row[col] -= v * w_row[col];
+                    }
+                }
+            }
+        }
+
+        void apply_panel(std::size_t k0, std::size_t k1, bool transposed, double* c, std::size_t ldc, std::size_t first, std::size_t last) const {
+            const auto width = k1 - k0;
+            memory::arena_scope scratch;
+            auto* t = scratch.allocate<double>(width * width);
+            triangular_factor(k0, k1, t);
+
+            for_chunks(first, last, block, (m - k0) * (last - first) * width * 2, [&](std::size_t chunk_first, std::size_t chunk_last) {
+                apply_block(k0, k1, t, transposed, c, ldc, chunk_first, chunk_last);
+            });
+        }
+    public:
+        householder_qr(double* values, std::size_t rows, std::size_t columns, double* scalars)
+            : a(values), m(rows), n(columns), tau(scalars) {
+            if (m < n) {
+                throw std::runtime_error("QR decomposition: the matrix must have at least as many rows as columns");
+            }
+
+            for (std::size_t k0 = 0; k0 < n; k0 += block) {
+                const auto k1 = std::min(k0 + block, n);
+
+                for (auto j = k0; j < k1; ++j) {
+                    double norm{ 0.0 };
+                    for (auto r = j; r < m; ++r) {
+                        norm += a[r * n + j] * a[r * n + j];
+                    }
+                    norm = std::sqrt(norm);
+
+                    const auto alpha = a[j * n + j];
+                    if (norm == 0.0) {
+                        tau[j] = 0.0;
+                        continue;
+                    }
+
+                    const auto beta = -std::copysign(norm, alpha);
+                    const auto scale = 1.0 / (alpha - beta);
+                    for (auto r = j + 1; r < m; ++r) {
+                        a[r * n + j] *= scale;
+                    }
+                    tau[j] = (beta - alpha) / beta;
+                    a[j * n + j] = beta;
+
+                    // the rest of the panel: w = v^T A(j:m, j+1:k1), A -= tau v w
+                    const auto columns = k1 - j - 1;
+                    if (columns == 0) {
+                        continue;
+                    }
+
+                    double w[block]{};
+                    for (auto r = j; r < m; ++r) {
+                        const auto v = reflector(r, j);
+                        for (std::size_t col = 0; col < columns; ++col) {
+                            w[col] += v * a[r * n + j + 1 + col];
+                        }
+                    }
+                    for (auto r = j; r < m; ++r) {
+                        const auto v = tau[j] * reflector(r, j);
+                        for (std::size_t col = 0; col < columns; ++col) {
+                            a[r * n + j + 1 + col] -= v * w[col];
+                        }
+                    }
+                }
+
+                apply_panel(k0, k1, true, a, n, k1, n);
+            }
+        }
+
+        // b = Q^T b for the m x nrhs matrix b
+        void apply_qt(double* b, std::size_t nrhs) const {
+            for (std::size_t k0 = 0; k0 < n; k0 += block) {
+                apply_panel(k0, std::min(k0 + block, n), true, b, nrhs, 0, nrhs);
+            }
+        }
+
+        // b = Q b for the m x nrhs matrix b
+        void apply_q(double* b, std::size_t nrhs) const {
+            for (auto panel = (n + block - 1) / block; panel-- > 0;) {
+                const auto k0 = panel * block;
+                apply_panel(k0, std::min(k0 + block, n), false, b, nrhs, 0, nrhs);
+            }
+        }
+
+        // Solves R x = b for the top n rows of the m x nrhs matrix b (in place).
+        void solve_r(double* b, std::size_t nrhs) const {
+            double largest{ 0.0 };
+            for (std::size_t i = 0; i < n; ++i) {
+                largest = std::max(largest, std::abs(a[i * n + i]));
+            }
+
+            const auto limit = largest * static_cast<double>(m) * std::numeric_limits<double>::epsilon();
+            for (auto i = n; i-- > 0;) {
+                const auto diagonal = a[i * n + i];
+                if (std::abs(diagonal) <= limit) {
+                    throw std::runtime_error("Least squares operation: the matrix is rank deficient");
+                }
+
+                auto* row = b + i * nrhs;
+                for (auto p = i + 1; p < n; ++p) {
+                    const auto factor = a[i * n + p];
+                    for (std::size_t c = 0; c < nrhs; ++c) {
+                        row[c] -= factor * b[p * nrhs + c];
+                    }
+                }
+                for (std::size_t c = 0; c < nrhs; ++c) {
+                    row[c] /= diagonal;
+                }
+            }
+        }
+    };
+}
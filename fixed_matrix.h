@@ -13,9 +13,14 @@
 #pragma once
 
 #include <array>
+#include <span>
 #include <type_traits>
 
 #include "utility.h"
+#include "parallel.h"
+#include "reduction.h"
+#include "tuning.h"
+#include "views.h"
 
 namespace matrices {
     template<typename T, typename U>
@@ -33,6 +38,17 @@ namespace matrices {
     template<typename T, std::uint32_t SubRows, std::uint32_t SubColumns, std::uint32_t StartRow, std::uint32_t StartColumn>
     concept is_valid_taking_submatrix = utility::is_matrix<T> && (SubRows > 0 && (StartRow + SubRows) <= T::rows_count && SubColumns > 0 && (StartColumn + SubColumns) <= T::columns_count);
 
+    template<typename T, utility::Transposition Op>
+    inline constexpr std::uint32_t operation_rows = Op == utility::Transposition::None ? T::rows_count : T::columns_count;
+
+    template<typename T, utility::Transposition Op>
+    inline constexpr std::uint32_t operation_columns = Op == utility::Transposition::None ? T::columns_count : T::rows_count;
+
+    template<typename Result, typename T, utility::Transposition OpT, typename U, utility::Transposition OpU>
+    concept is_gemm_compatible = utility::is_matrix<Result> && utility::is_matrix<T> && utility::is_matrix<U> &&
+        (operation_columns<T, OpT> == operation_rows<U, OpU>) &&
+        (operation_rows<T, OpT> == Result::rows_count) && (operation_columns<U, OpU> == Result::columns_count);
+
     template<utility::Scalar T, std::uint32_t Rows, std::uint32_t Columns = Rows>
     requires (Rows > 0 && Columns > 0)
     class matrix_f final {
@@ -49,7 +65,7 @@ namespace matrices {
         void make_identity() {
             auto min_dim = std::min(rows_count, columns_count);
             for (index_type ri = 0; ri < min_dim; ++ri) {
-                operator()(ri, ri) = { 1 };
+                unchecked(ri, ri) = { 1 };
             }
         }
 
@@ -64,7 +80,7 @@ namespace matrices {
                         index_type m_row = (ri < row) ? ri : ri - 1;
                         index_type m_col = (ci < col) ? ci : ci - 1;
 
-                        result(m_row, m_col) = matrix(ri, ci);
+                        result.unchecked(m_row, m_col) = matrix.unchecked(ri, ci);
                     }
                 }
             }
@@ -75,7 +91,7 @@ namespace matrices {
         template<is_square U>
         [[nodiscard]] double determinant(const U& matrix) const {
             if constexpr (U::rows_count == 1) {
-                return matrix(0, 0);
+                return matrix.unchecked(0, 0);
             }
             else {
                 double result = 0;
@@ -83,7 +99,7 @@ namespace matrices {
 
                 for (index_type ci = 0; ci < U::columns_count; ++ci) {
                     auto minor = get_minor(matrix, 0, ci);
-                    result += sign * matrix(0, ci) * determinant(minor);
+                    result += sign * matrix.unchecked(0, ci) * determinant(minor);
                     sign *= -1;
                 }
 
@@ -125,25 +141,112 @@ namespace matrices {
             return columns_count;
         }
 
+        // Bounds checked only with MATRICES_CHECKED_ACCESS (debug builds), see at() for an always checked access.
         [[nodiscard]] internal_type& operator()(const index_type& row, const index_type& col)
         {
-            if (row >= rows_count || col >= columns_count) {
-                std::out_of_range("Invalid row column index");
+            if constexpr (checked_access) {
+                check_index(row < rows_count && col < columns_count);
             }
-            return data[row * Columns + col];
+            return unchecked(row, col);
         }
 
         [[nodiscard]] internal_type operator()(const index_type& row, const index_type& col) const
         {
-            if (row >= rows_count || col >= columns_count) {
-                std::out_of_range("Invalid row column index");
+            if constexpr (checked_access) {
+                check_index(row < rows_count && col < columns_count);
             }
-            return data[row * Columns + col];
+            return unchecked(row, col);
         }
 
         [[nodiscard]] internal_type& operator[](const index_type& index)
         {
-            return data.at(index);
+            if constexpr (checked_access) {
+                check_index(index < size);
+            }
+            return data[index];
+        }
+
+        [[nodiscard]] internal_type operator[](const index_type& index) const
+        {
+            if constexpr (checked_access) {
+                check_index(index < size);
+            }
+            return data[index];
+        }
+
+        [[nodiscard]] internal_type& at(const index_type& row, const index_type& col) {
+            check_index(row < rows_count && col < columns_count);
+            return unchecked(row, col);
+        }
+
+        [[nodiscard]] internal_type at(const index_type& row, const index_type& col) const {
+            check_index(row < rows_count && col < columns_count);
+            return unchecked(row, col);
+        }
+
+        // Row major linear index, always checked.
+        [[nodiscard]] internal_type& at(const index_type& index) {
+            check_index(index < size);
+            return data[index];
+        }
+
+        [[nodiscard]] internal_type at(const index_type& index) const {
+            check_index(index < size);
+            return data[index];
+        }
+
+        // Element access of the inner loops, never checked.
+        [[nodiscard]] internal_type& unchecked(index_type row, index_type col) {
+            return data[row * Columns + col];
+        }
+
+        [[nodiscard]] internal_type unchecked(index_type row, index_type col) const {
+            return data[row * Columns + col];
+        }
+
+        // Row major elements as one contiguous range.
+        [[nodiscard]] internal_type* begin() {
+            return data.data();
+        }
+
+        [[nodiscard]] internal_type* end() {
+            return data.data() + size;
+        }
+
+        [[nodiscard]] const internal_type* begin() const {
+            return data.data();
+        }
+
+        [[nodiscard]] const internal_type* end() const {
+            return data.data() + size;
+        }
+
+        [[nodiscard]] std::span<internal_type, Columns> row_span(index_type row) {
+            if constexpr (checked_access) {
+                check_index(row < rows_count);
+            }
+            return std::span<internal_type, Columns>(data.data() + row * Columns, Columns);
+        }
+
+        [[nodiscard]] std::span<const internal_type, Columns> row_span(index_type row) const {
+            if constexpr (checked_access) {
+                check_index(row < rows_count);
+            }
+            return std::span<const internal_type, Columns>(data.data() + row * Columns, Columns);
+        }
+
+        [[nodiscard]] strided_span<internal_type> column_range(index_type col) {
+            if constexpr (checked_access) {
+                check_index(col < columns_count);
+            }
+            return { data.data() + col, Rows, Columns };
+        }
+
+        [[nodiscard]] strided_span<const internal_type> column_range(index_type col) const {
+            if constexpr (checked_access) {
+                check_index(col < columns_count);
+            }
+            return { data.data() + col, Rows, Columns };
         }
 
         template<typename U> requires is_multiplicable<matrix_f, U>
@@ -153,11 +256,11 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < U::columns_count; ++ci) {
-                    result_type dot = utility::multiply(operator()(ri, 0), other(0, ci));
+                    result_type dot = utility::multiply(unchecked(ri, 0), other.unchecked(0, ci));
                     for (size_t k = 1; k < Columns; ++k) {
-                        dot = utility::add(dot, utility::multiply(operator()(ri, k), other(k, ci)));
+                        dot = utility::add(dot, utility::multiply(unchecked(ri, k), other.unchecked(k, ci)));
                     }
-                    result(ri, ci) = dot;
+                    result.unchecked(ri, ci) = dot;
                 }
             }
 
@@ -172,24 +275,98 @@ namespace matrices {
             auto multiply_row_adn_col = [&](int row, int col) {
                 T sum = 0;
                 for (index_type k = 0; k < columns_count; ++k) {
-                    sum += operator()(row, k) * other(k, col);
+                    sum += unchecked(row, k) * other.unchecked(k, col);
                 }
-                result(row, col) = sum;
+                result.unchecked(row, col) = sum;
             };
 
-            std::vector<std::thread> threads;
+            auto multiply_rows = [&](std::size_t first, std::size_t last) {
+                for (auto ri = first; ri < last; ++ri) {
+                    for (index_type ci = 0; ci < other.columns_count; ++ci) {
+                        multiply_row_adn_col(static_cast<int>(ri), ci);
+                    }
+                }
+            };
+
+            // rows are split between the pool workers, small products are not worth starting threads for
+            constexpr std::size_t multiply_adds = std::size_t{ rows_count } * columns_count * U::columns_count;
+            if (multiply_adds < tuning::current().fixed_parallel_threshold) {
+                multiply_rows(0, rows_count);
+            }
+            else {
+                utility::parallel_for(0, rows_count, 1, multiply_rows);
+            }
+
+            return result;
+        }
+
+        // this = alpha * op(left) * op(right) + beta * this, the transposed operands are read in place.
+        // With beta equal to zero the previous contents are not read.
+        template<utility::Transposition LeftOp, utility::Transposition RightOp, typename U, typename V>
+        requires is_gemm_compatible<matrix_f, U, LeftOp, V, RightOp>
+        void gemm(const internal_type& alpha, const U& left, const V& right, const internal_type& beta) {
+            constexpr index_type depth = operation_columns<U, LeftOp>;
+
+            auto left_at = [&](index_type row, index_type col) {
+                if constexpr (LeftOp == utility::Transposition::None) {
+                    return left.unchecked(row, col);
+                }
+                else {
+                    return left.unchecked(col, row);
+                }
+            };
+
+            auto right_at = [&](index_type row, index_type col) {
+                if constexpr (RightOp == utility::Transposition::None) {
+                    return right.unchecked(row, col);
+                }
+                else {
+                    return right.unchecked(col, row);
+                }
+            };
+
+            if (static_cast<const void*>(&left) == this || static_cast<const void*>(&right) == this) {
+                matrix_f<T, Rows, Columns> result(*this);
+                result.template gemm<LeftOp, RightOp>(alpha, left, right, beta);
+                *this = result;
+                return;
+            }
+
+            for (auto& value : data) {
+                value = beta == internal_type{ 0 } ? internal_type{ 0 } : static_cast<internal_type>(beta * value);
+            }
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
-                for (index_type ci = 0; ci < other.columns_count; ++ci) {
-                    threads.emplace_back(multiply_row_adn_col, ri, ci);
+                for (index_type k = 0; k < depth; ++k) {
+                    auto left_value = static_cast<internal_type>(alpha * left_at(ri, k));
+                    for (index_type ci = 0; ci < columns_count; ++ci) {
+                        data[ri * Columns + ci] += static_cast<internal_type>(left_value * right_at(k, ci));
+                    }
                 }
             }
+        }
 
-            for (auto& thread : threads) {
-                thread.join();
+        // result = alpha * op(this) * vector + beta * result
+        template<utility::Transposition Op>
+        void gemv(const internal_type& alpha, const std::array<internal_type, operation_columns<matrix_f, Op>>& vector,
+            const internal_type& beta, std::array<internal_type, operation_rows<matrix_f, Op>>& result) const {
+            std::array<internal_type, operation_rows<matrix_f, Op>> sums{};
+
+            for (index_type ri = 0; ri < rows_count; ++ri) {
+                for (index_type ci = 0; ci < columns_count; ++ci) {
+                    if constexpr (Op == utility::Transposition::None) {
+                        sums[ri] += data[ri * Columns + ci] * vector[ci];
+                    }
+                    else {
+                        sums[ci] += data[ri * Columns + ci] * vector[ri];
+                    }
+                }
             }
 
-            return result;
+            for (index_type index = 0; index < result.size(); ++index) {
+                auto scaled = beta == internal_type{ 0 } ? internal_type{ 0 } : static_cast<internal_type>(beta * result[index]);
+                result[index] = static_cast<internal_type>(scaled + alpha * sums[index]);
+            }
         }
 
         template<typename U> requires is_same_dimensions<matrix_f, U>
@@ -199,7 +376,7 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::add(operator()(ri, ci), other(ri, ci));
+                    result.unchecked(ri, ci) = utility::add(unchecked(ri, ci), other.unchecked(ri, ci));
                 }
             }
 
@@ -213,7 +390,7 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::subtract(operator()(ri, ci), other(ri, ci));
+                    result.unchecked(ri, ci) = utility::subtract(unchecked(ri, ci), other.unchecked(ri, ci));
                 }
             }
 
@@ -227,7 +404,7 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::add(operator()(ri, ci), value);
+                    result.unchecked(ri, ci) = utility::add(unchecked(ri, ci), value);
                 }
             }
 
@@ -241,7 +418,7 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::subtract(operator()(ri, ci), value);
+                    result.unchecked(ri, ci) = utility::subtract(unchecked(ri, ci), value);
                 }
             }
 
@@ -255,7 +432,7 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = utility::multiply(operator()(ri, ci), value);
+                    result.unchecked(ri, ci) = utility::multiply(unchecked(ri, ci), value);
                 }
             }
 
@@ -267,31 +444,31 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    augmented_matrix(ri, ci) = operator()(ri, ci);
+                    augmented_matrix.unchecked(ri, ci) = unchecked(ri, ci);
                 }
-                augmented_matrix(ri, ri + rows_count) = 1.0;
+                augmented_matrix.unchecked(ri, ri + rows_count) = 1.0;
             }
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
-                if (augmented_matrix(ri, ri) == 0.0) {
+                if (augmented_matrix.unchecked(ri, ri) == 0.0) {
                     throw std::runtime_error("Inverse matrix operation: Invertible matrix");
                 }
 
-                double pivot = augmented_matrix(ri, ri);
+                double pivot = augmented_matrix.unchecked(ri, ri);
                 if (pivot == 0.0) {
                     throw std::runtime_error("Inverse matrix operation: can't calculate matrix");
                 }
 
                 for (index_type ci = 0; ci < augmented_matrix.columns_count; ++ci) {
-                    augmented_matrix(ri, ci) = augmented_matrix(ri, ci) / pivot;
+                    augmented_matrix.unchecked(ri, ci) = augmented_matrix.unchecked(ri, ci) / pivot;
                 }
 
                 for (index_type k = 0; k < rows_count; ++k) {
                     if (k != ri) {
-                        double factor = augmented_matrix(k, ri);
+                        double factor = augmented_matrix.unchecked(k, ri);
 
                         for (index_type ci = 0; ci < augmented_matrix.columns_count; ++ci) {
-                            augmented_matrix(k, ci) = augmented_matrix(k, ci) - factor * augmented_matrix(ri, ci);
+                            augmented_matrix.unchecked(k, ci) = augmented_matrix.unchecked(k, ci) - factor * augmented_matrix.unchecked(ri, ci);
                         }
                     }
                 }
@@ -301,7 +478,7 @@ namespace matrices {
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ri, ci) = augmented_matrix(ri, ci + Columns);
+                    result.unchecked(ri, ci) = augmented_matrix.unchecked(ri, ci + Columns);
                 }
             }
 
@@ -318,14 +495,14 @@ namespace matrices {
             }
 
             if constexpr (rows_count == 1) {
-                result(0, 0) = 1.0 / static_cast<double>(det);
+                result.unchecked(0, 0) = 1.0 / static_cast<double>(det);
             }
             else {
                 for (index_type ri = 0; ri < rows_count; ++ri) {
                     for (index_type ci = 0; ci < columns_count; ++ci) {
                         auto minor = get_minor(*this, ri, ci);
                         auto tmp = (determinant(minor) / static_cast<double>(det)) * (((ri + ci) % 2) ? -1 : 1);
-                        result(ci, ri) = tmp;
+                        result.unchecked(ci, ri) = tmp;
                     }
                 }
             }
@@ -339,18 +516,57 @@ namespace matrices {
 
             for (index_type ri = 0; ri < SubRows; ++ri) {
                 for (index_type ci = 0; ci < SubColumns; ++ci) {
-                    result(ri, ci) = operator()(StartRow + ri, StartColumn + ci);
+                    result.unchecked(ri, ci) = unchecked(StartRow + ri, StartColumn + ci);
                 }
             }
             return result;
         }
 
+        [[nodiscard]] double sum() const {
+            return reduction::sum(data.data(), size);
+        }
+
+        [[nodiscard]] double frobenius_norm() const {
+            return reduction::norm(data.data(), size);
+        }
+
+        [[nodiscard]] double trace() const requires is_square<matrix_f> {
+            return reduction::sum(data.data(), rows_count, columns_count + 1);
+        }
+
+        [[nodiscard]] internal_type min() const {
+            return reduction::min(data.data(), size);
+        }
+
+        [[nodiscard]] internal_type max() const {
+            return reduction::max(data.data(), size);
+        }
+
+        template<typename U> requires is_same_dimensions<matrix_f, U>
+        [[nodiscard]] double dot(const U& other) const {
+            return reduction::dot(data.data(), other.data.data(), size);
+        }
+
+        [[nodiscard]] std::array<double, rows_count> reduce_rows(utility::Reduction kind) const {
+            std::array<double, rows_count> result{};
+            auto values = reduction::rows(data.data(), rows_count, columns_count, columns_count, kind);
+            std::copy(std::begin(values), std::end(values), std::begin(result));
+            return result;
+        }
+
+        [[nodiscard]] std::array<double, columns_count> reduce_columns(utility::Reduction kind) const {
+            std::array<double, columns_count> result{};
+            auto values = reduction::columns(data.data(), rows_count, columns_count, columns_count, kind);
+            std::copy(std::begin(values), std::end(values), std::begin(result));
+            return result;
+        }
+
         [[nodiscard]] matrix_f<T, columns_count, rows_count> transpose() const {
             matrix_f<T, columns_count, rows_count> result{};
 
             for (index_type ri = 0; ri < rows_count; ++ri) {
                 for (index_type ci = 0; ci < columns_count; ++ci) {
-                    result(ci, ri) = operator()(ri, ci);
+                    result.unchecked(ci, ri) = unchecked(ri, ci);
                 }
             }
 
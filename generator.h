@@ -0,0 +1,232 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <future>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "dynamic_matrix.h"
+#include "parallel.h"
+#include "profiler.h"
+
+// Synthetic matrices for benchmarks and load tests. Every element is a pure function of the seed and its
+// position, so the output is the same for a given seed whatever the number of threads, and files larger than
+// the memory can be written a batch of rows at a time.
+namespace matrices::generator {
+    enum class Distribution : short {
+        Uniform,
+        Normal,
+        Identity,
+        Banded,
+        SPD,
+        Sparse
+    };
+
+    struct options {
+        Distribution distribution{ Distribution::Uniform };
+        std::uint32_t rows{ 1 };
+        std::uint32_t columns{ 1 };
+        std::uint64_t seed{ 42 };
+        // range of the uniform, banded and sparse values
+        double low{ -1.0 };
+        double high{ 1.0 };
+        double mean{ 0.0 };
+        double deviation{ 1.0 };
+        // diagonals kept on each side of the main one (banded)
+        std::uint32_t bandwidth{ 1 };
+        // share of nonzero elements (sparse)
+        double density{ 0.1 };
+    };
+
+    // Counter based generator: a draw depends only on the key and the counter, not on the draws before it
+    // (the SplitMix64 output function applied to a Weyl sequence).
+    class counter_rng final {
+        std::uint64_t key;
+
+        [[nodiscard]] static std::uint64_t mix(std::uint64_t value) {
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+            return value ^ (value >> 31);
+        }
+    public:
+        // independent streams of the same seed get unrelated keys
+        explicit counter_rng(std::uint64_t seed, std::uint64_t stream = 0) : key(mix(mix(seed) + stream * 0xD1B54A32D192ED03ull)) {
+        }
+
+        [[nodiscard]] std::uint64_t bits(std::uint64_t counter) const {
+            return mix(key + (counter + 1) * 0x9E3779B97F4A7C15ull);
+        }
+
+        // [0, 1) with 53 random bits
+        [[nodiscard]] double uniform(std::uint64_t counter) const {
+            return static_cast<double>(bits(counter) >> 11) * 0x1.0p-53;
+        }
+
+        // standard normal by Box-Muller from the counters 2 * counter and 2 * counter + 1
+        [[nodiscard]] double normal(std::uint64_t counter) const {
+            auto radius = std::sqrt(-2.0 * std::log(1.0 - uniform(2 * counter)));
+            return radius * std::cos(2.0 * std::numbers::pi * uniform(2 * counter + 1));
+        }
+    };
+
+    // Value of any element of the generated matrix.
+    class source final {
+        options settings;
+        counter_rng values;
+        counter_rng mask;
+    public:
+        explicit source(const options& settings) : settings(settings), values(settings.seed), mask(settings.seed, 1) {
+            if (settings.rows == 0 || settings.columns == 0) {
+                throw std::runtime_error("Generate operation: the matrix must have at least one row and one column");
+            }
+            if (settings.distribution == Distribution::SPD && settings.rows != settings.columns) {
+                throw std::runtime_error("Generate operation: a symmetric positive definite matrix must be square");
+            }
+            if (!(settings.density >= 0.0 && settings.density <= 1.0)) {
+                throw std::runtime_error("Generate operation: the density must be between 0 and 1");
+            }
+            if (!(settings.low <= settings.high) || !(settings.deviation >= 0.0)) {
+                throw std::runtime_error("Generate operation: invalid value range");
+            }
+        }
+
+        [[nodiscard]] std::uint32_t get_rows_count() const {
+            return settings.rows;
+        }
+
+        [[nodiscard]] std::uint32_t get_columns_count() const {
+            return settings.columns;
+        }
+
+        [[nodiscard]] double operator()(std::uint32_t row, std::uint32_t col) const {
+            auto counter = static_cast<std::uint64_t>(row) * settings.columns + col;
+            auto uniform = [&](std::uint64_t index) {
+                return settings.low + (settings.high - settings.low) * values.uniform(index);
+            };
+
+            switch (settings.distribution) {
+            case Distribution::Uniform:
+                return uniform(counter);
+            case Distribution::Normal:
+                return settings.mean + settings.deviation * values.normal(counter);
+            case Distribution::Identity:
+                return row == col ? 1.0 : 0.0;
+            case Distribution::Banded:
+                return std::max(row, col) - std::min(row, col) <= settings.bandwidth ? uniform(counter) : 0.0;
+            case Distribution::Sparse:
+                return mask.uniform(counter) < settings.density ? uniform(counter) : 0.0;
+            case Distribution::SPD: {
+                // symmetric with off diagonal values in (-1, 1) and n on the diagonal: strictly diagonally
+                // dominant with a positive diagonal, hence positive definite
+                if (row == col) {
+                    return static_cast<double>(settings.columns);
+                }
+                auto pair = static_cast<std::uint64_t>(std::min(row, col)) * settings.columns + std::max(row, col);
+                return 2.0 * values.uniform(pair) - 1.0;
+            }
+            }
+            return 0.0;
+        }
+    };
+
+    [[nodiscard]] inline matrix_d<double> generate(const options& settings) {
+        MATRICES_PROFILE_SCOPE("generate", "phase");
+        source values(settings);
+
+        matrix_d<double> result(settings.rows, settings.columns);
+        // the workers write through one pointer taken up front, not through the copy-on-write accessors
+        auto* elements = result.begin();
+        utility::parallel_for(0, settings.rows, 16, [&](std::size_t first, std::size_t last) {
+            for (auto ri = first; ri < last; ++ri) {
+                auto* row = elements + ri * settings.columns;
+                for (std::uint32_t ci = 0; ci < settings.columns; ++ci) {
+                    row[ci] = values(static_cast<std::uint32_t>(ri), ci);
+                }
+            }
+        });
+        return result;
+    }
+
+    namespace detail {
+        // one CSV line with the shortest representation that reads back to the same double
+        inline void format_row(const source& values, std::uint32_t row, std::string& line, const char delim) {
+            line.clear();
+            char buffer[32];
+            for (std::uint32_t ci = 0; ci < values.get_columns_count(); ++ci) {
+                if (ci > 0) {
+                    line.push_back(delim);
+                }
+                auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), values(row, ci));
+                line.append(buffer, end);
+            }
+            line.push_back('\n');
+        }
+    }
+
+    // Writes the matrix to a CSV file without holding it in memory. Batches of rows are formatted in parallel
+    // while the previous batch is written.
+    inline void to_csv(const std::filesystem::path& path, const options& settings, const char delim = ',') {
+        MATRICES_PROFILE_SCOPE("generate", "phase");
+        source values(settings);
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file for writting");
+        }
+
+        constexpr std::size_t batch_elements = std::size_t{ 1 } << 18;
+        const auto batch_rows = static_cast<std::uint32_t>(std::clamp<std::size_t>(batch_elements / settings.columns, 1, settings.rows));
+
+        std::vector<std::string> formatting(batch_rows), writing(batch_rows);
+        std::future<void> pending;
+
+        for (std::uint32_t first = 0; first < settings.rows; first += batch_rows) {
+            auto count = std::min(batch_rows, settings.rows - first);
+            utility::parallel_for(0, count, 4, [&](std::size_t chunk_first, std::size_t chunk_last) {
+                for (auto index = chunk_first; index < chunk_last; ++index) {
+                    detail::format_row(values, first + static_cast<std::uint32_t>(index), formatting[index], delim);
+                }
+            });
+
+            if (pending.valid()) {
+                pending.get();
+            }
+            std::swap(formatting, writing);
+            pending = std::async(std::launch::async, [&file, &writing, count]() {
+                MATRICES_PROFILE_SCOPE("write", "phase");
+                for (std::uint32_t index = 0; index < count; ++index) {
+                    file.write(writing[index].data(), static_cast<std::streamsize>(writing[index].size()));
+                }
+            });
+        }
+
+        if (pending.valid()) {
+            pending.get();
+        }
+        file.close();
+        if (!file) {
+            throw std::runtime_error("Unable to write the generated matrix");
+        }
+        std::cout << std::format("Exported to {}\n", path.string());
+    }
+}
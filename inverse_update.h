@@ -0,0 +1,220 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "dynamic_matrix.h"
+
+namespace matrices {
+    // A square matrix kept together with its inverse. Low rank changes A += U * V^T (U, V of n x k) update the
+    // inverse with the Sherman-Morrison-Woodbury formula in O(n^2 k) instead of a new O(n^3) inversion:
+    //     (A + U V^T)^-1 = B - B U (I + V^T B U)^-1 V^T B,   B = A^-1
+    // Rounding errors accumulate over the updates, so every `check_interval` updates the inverse is probed with
+    // a random vector and fully recomputed once the relative error exceeds `tolerance`.
+    class updatable_inverse final {
+        using index_type = std::uint32_t;
+
+        matrix_d<double> matrix_value;
+        matrix_d<double> inverse_value;
+
+        std::size_t check_interval{ 32 };
+        double tolerance{ 1e-8 };
+        std::size_t updates_since_check{ 0 };
+        std::size_t refactorizations{ 0 };
+        std::mt19937_64 probe_engine{ 0x5eed };
+
+        // Only the inverse is updated, the caller changes the matrix itself.
+        void update_inverse(const matrix_d<double>& u, const matrix_d<double>& v) {
+            const auto n = matrix_value.get_rows_count();
+            const auto k = u.get_columns_count();
+
+            if (u.get_rows_count() != n || v.get_rows_count() != n || v.get_columns_count() != k) {
+                throw std::runtime_error("Inverse update operation: The conditions of the operation are not met");
+            }
+
+            matrix_d<double> bu(n, k);
+            bu.gemm(1.0, inverse_value, utility::Transposition::None, u, utility::Transposition::None, 0.0);
+
+            matrix_d<double> vtb(k, n);
+            vtb.gemm(1.0, v, utility::Transposition::Transpose, inverse_value, utility::Transposition::None, 0.0);
+
+            // capacitance I + V^T B U, singular exactly when the updated matrix is
+            matrix_d<double> capacitance(k, k);
+            capacitance.gemm(1.0, v, utility::Transposition::Transpose, bu, utility::Transposition::None, 1.0);
+
+            matrix_d<double> correction;
+            try {
+                correction = capacitance.solve(vtb);
+            }
+            catch (const std::runtime_error&) {
+                throw std::runtime_error("Inverse update operation: the updated matrix is singular");
+            }
+
+            inverse_value.gemm(-1.0, bu, utility::Transposition::None, correction, utility::Transposition::None, 1.0);
+        }
+
+        void after_update() {
+            if (check_interval != 0 && ++updates_since_check >= check_interval) {
+                check();
+            }
+        }
+    public:
+        explicit updatable_inverse(const matrix_d<double>& matrix, std::size_t check_interval = 32, double tolerance = 1e-8)
+            : matrix_value(matrix), check_interval(check_interval), tolerance(tolerance) {
+            if (matrix_value.get_rows_count() != matrix_value.get_columns_count()) {
+                throw std::runtime_error("The matrix is not square");
+            }
+            refactorize();
+            refactorizations = 0;
+        }
+
+        [[nodiscard]] const matrix_d<double>& matrix() const {
+            return matrix_value;
+        }
+
+        [[nodiscard]] const matrix_d<double>& inverse() const {
+            return inverse_value;
+        }
+
+        // number of full recomputations triggered by the accuracy check
+        [[nodiscard]] std::size_t refactorizations_count() const {
+            return refactorizations;
+        }
+
+        // A += U * V^T
+        void update(const matrix_d<double>& u, const matrix_d<double>& v) {
+            update_inverse(u, v);
+            matrix_value.gemm(1.0, u, utility::Transposition::None, v, utility::Transposition::Transpose, 1.0);
+            after_update();
+        }
+
+        // A += u * v^T
+        void update(const std::vector<double>& u, const std::vector<double>& v) {
+            const auto n = matrix_value.get_rows_count();
+            if (u.size() != n || v.size() != n) {
+                throw std::runtime_error("Inverse update operation: The conditions of the operation are not met");
+            }
+
+            update(matrix_d<double>(n, 1, std::vector<double>(u)), matrix_d<double>(n, 1, std::vector<double>(v)));
+        }
+
+        // Row `row` of A becomes `values`: u = e_row, v = values - old row.
+        void replace_row(index_type row, const std::vector<double>& values) {
+            const auto n = matrix_value.get_rows_count();
+            if (row >= n || values.size() != n) {
+                throw std::runtime_error("Replace row operation: The conditions of the operation are not met");
+            }
+
+            matrix_d<double> u(n, 1), v(n, 1);
+            u(0, 0) = 0.0;
+            u(row, 0) = 1.0;
+            for (index_type ci = 0; ci < n; ++ci) {
+                v(ci, 0) = values[ci] - std::as_const(matrix_value)(row, ci);
+            }
+
+            update_inverse(u, v);
+            for (index_type ci = 0; ci < n; ++ci) {
+                matrix_value(row, ci) = values[ci];
+            }
+            after_update();
+        }
+
+        // Column `column` of A becomes `values`: u = values - old column, v = e_column.
+        void replace_column(index_type column, const std::vector<double>& values) {
+            const auto n = matrix_value.get_rows_count();
+            if (column >= n || values.size() != n) {
+                throw std::runtime_error("Replace column operation: The conditions of the operation are not met");
+            }
+
+            matrix_d<double> u(n, 1), v(n, 1);
+            v(0, 0) = 0.0;
+            v(column, 0) = 1.0;
+            for (index_type ri = 0; ri < n; ++ri) {
+                u(ri, 0) = values[ri] - std::as_const(matrix_value)(ri, column);
+            }
+
+            update_inverse(u, v);
+            for (index_type ri = 0; ri < n; ++ri) {
+                matrix_value(ri, column) = values[ri];
+            }
+            after_update();
+        }
+
+        // A(row, column) = value, a rank one update with u = delta * e_row and v = e_column.
+        void set_element(index_type row, index_type column, double value) {
+            const auto n = matrix_value.get_rows_count();
+            if (row >= n || column >= n) {
+                throw std::runtime_error("Set element operation: The conditions of the operation are not met");
+            }
+
+            matrix_d<double> u(n, 1), v(n, 1);
+            u(0, 0) = 0.0;
+            v(0, 0) = 0.0;
+            u(row, 0) = value - std::as_const(matrix_value)(row, column);
+            v(column, 0) = 1.0;
+
+            update_inverse(u, v);
+            matrix_value(row, column) = value;
+            after_update();
+        }
+
+        // Relative error ||A^-1 (A x) - x|| / ||x|| for a random probe x, O(n^2).
+        [[nodiscard]] double drift() {
+            const auto n = matrix_value.get_rows_count();
+            if (n == 0) {
+                return 0.0;
+            }
+
+            std::normal_distribution<double> distribution;
+            std::vector<double> probe(n), image(n), restored(n);
+            for (auto& value : probe) {
+                value = distribution(probe_engine);
+            }
+
+            matrix_value.gemv(1.0, utility::Transposition::None, probe, 0.0, image);
+            inverse_value.gemv(1.0, utility::Transposition::None, image, 0.0, restored);
+
+            double error{ 0.0 }, norm{ 0.0 };
+            for (index_type index = 0; index < n; ++index) {
+                error += (restored[index] - probe[index]) * (restored[index] - probe[index]);
+                norm += probe[index] * probe[index];
+            }
+            return std::sqrt(error / norm);
+        }
+
+        // Recomputes the inverse when the drift exceeds the tolerance. Returns true if it did.
+        bool check() {
+            updates_since_check = 0;
+            if (drift() <= tolerance) {
+                return false;
+            }
+
+            refactorize();
+            return true;
+        }
+
+        // Full O(n^3) recomputation from the current matrix, with partial pivoting.
+        void refactorize() {
+            const auto n = matrix_value.get_rows_count();
+            inverse_value = matrix_value.solve(matrix_d<double>(n, n));
+            updates_since_check = 0;
+            ++refactorizations;
+        }
+    };
+}
@@ -0,0 +1,192 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace matrices::mapping {
+    // Read only view of a whole file. On Linux the file is memory mapped, so its pages are read on demand and
+    // shared with the page cache instead of being copied, elsewhere it is read into memory.
+    class mapped_file final {
+        const char* address{ nullptr };
+        std::size_t length{ 0 };
+#ifndef __linux__
+        std::string contents;
+#endif
+    public:
+        explicit mapped_file(const std::filesystem::path& path) {
+            if (!std::filesystem::exists(path) || !std::filesystem::is_regular_file(path)) {
+                throw std::runtime_error("Unable to open file for reading");
+            }
+#ifdef __linux__
+            auto descriptor = ::open(path.c_str(), O_RDONLY);
+            if (descriptor < 0) {
+                throw std::runtime_error("Unable to open file for reading");
+            }
+
+            struct stat status {};
+            if (::fstat(descriptor, &status) != 0) {
+                ::close(descriptor);
+                throw std::runtime_error("Unable to open file for reading");
+            }
+
+            length = static_cast<std::size_t>(status.st_size);
+            if (length > 0) {
+                auto* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (mapped == MAP_FAILED) {
+                    ::close(descriptor);
+                    throw std::runtime_error("Unable to map file for reading");
+                }
+                ::madvise(mapped, length, MADV_SEQUENTIAL);
+                address = static_cast<const char*>(mapped);
+            }
+            ::close(descriptor);
+#else
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) {
+                throw std::runtime_error("Unable to open file for reading");
+            }
+            contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            address = contents.data();
+            length = contents.size();
+#endif
+        }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        ~mapped_file() {
+#ifdef __linux__
+            if (address != nullptr) {
+                ::munmap(const_cast<char*>(address), length);
+            }
+#endif
+        }
+
+        [[nodiscard]] std::string_view view() const {
+            return { address, length };
+        }
+    };
+
+    // POSIX shared memory segment mapped for reading and writing. The process that creates it owns the name and
+    // unlinks it when the segment is destroyed, the memory itself lives until the last mapping is gone. The
+    // mapping is inherited by fork(), unrelated processes open the segment by its name.
+    class shared_segment final {
+        std::string segment_name;
+        std::byte* address{ nullptr };
+        std::size_t length{ 0 };
+        bool owner{ false };
+
+        shared_segment(std::string name, std::size_t bytes, bool create) : segment_name(std::move(name)), owner(create) {
+#ifdef __linux__
+            auto descriptor = ::shm_open(segment_name.c_str(), create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+            if (descriptor < 0) {
+                throw std::runtime_error("Shared memory: unable to open segment " + segment_name);
+            }
+
+            struct stat status {};
+            if ((create && ::ftruncate(descriptor, static_cast<off_t>(bytes)) != 0) || ::fstat(descriptor, &status) != 0) {
+                ::close(descriptor);
+                if (create) {
+                    ::shm_unlink(segment_name.c_str());
+                }
+                throw std::runtime_error("Shared memory: unable to size segment " + segment_name);
+            }
+
+            // ftruncate alone leaves a sparse tmpfs file: a full /dev/shm would surface as SIGBUS on the first
+            // write of a missing page instead of an error here
+            if (create && bytes > 0) {
+                auto reserved = ::posix_fallocate(descriptor, 0, static_cast<off_t>(bytes));
+                if (reserved != 0 && reserved != EOPNOTSUPP && reserved != EINVAL) {
+                    ::close(descriptor);
+                    ::shm_unlink(segment_name.c_str());
+                    throw std::runtime_error(reserved == ENOSPC ? "Shared memory: not enough space for segment " + segment_name :
+                        "Shared memory: unable to reserve segment " + segment_name);
+                }
+            }
+
+            length = static_cast<std::size_t>(status.st_size);
+            if (length > 0) {
+                auto* mapped = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+                if (mapped == MAP_FAILED) {
+                    ::close(descriptor);
+                    if (create) {
+                        ::shm_unlink(segment_name.c_str());
+                    }
+                    throw std::runtime_error("Shared memory: unable to map segment " + segment_name);
+                }
+                address = static_cast<std::byte*>(mapped);
+            }
+            ::close(descriptor);
+#else
+            throw std::runtime_error("Shared memory: not supported on this platform");
+#endif
+        }
+    public:
+        // a zero filled segment of `bytes` bytes, the name must start with a slash and be unused
+        [[nodiscard]] static shared_segment create(const std::string& name, std::size_t bytes) {
+            return shared_segment(name, bytes, true);
+        }
+
+        [[nodiscard]] static shared_segment open(const std::string& name) {
+            return shared_segment(name, 0, false);
+        }
+
+        shared_segment(shared_segment&& other) noexcept
+            : segment_name(std::move(other.segment_name)), address(std::exchange(other.address, nullptr)),
+            length(std::exchange(other.length, 0)), owner(std::exchange(other.owner, false)) {
+        }
+
+        shared_segment(const shared_segment&) = delete;
+        shared_segment& operator=(const shared_segment&) = delete;
+        shared_segment& operator=(shared_segment&&) = delete;
+
+        ~shared_segment() {
+#ifdef __linux__
+            if (address != nullptr) {
+                ::munmap(address, length);
+            }
+            if (owner) {
+                ::shm_unlink(segment_name.c_str());
+            }
+#endif
+        }
+
+        [[nodiscard]] std::byte* data() const {
+            return address;
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return length;
+        }
+
+        [[nodiscard]] const std::string& name() const {
+            return segment_name;
+        }
+    };
+}
@@ -14,3 +14,6 @@
 
 #include "fixed_matrix.h"
 #include "dynamic_matrix.h"
+#include "chain.h"
+#include "inverse_update.h"
+#include "spectral.h"
@@ -0,0 +1,411 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <format>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#include "profiler.h"
+
+namespace matrices::memory {
+    // SIMD friendly alignment of every matrix buffer (one cache line, a full AVX-512 register).
+    inline constexpr std::size_t alignment = 64;
+    // Buffers of at least this size are aligned and rounded to huge pages.
+    inline constexpr std::size_t huge_page_size = std::size_t{ 2 } << 20;
+
+    [[nodiscard]] inline std::size_t round_up(std::size_t value, std::size_t granularity) {
+        return (value + granularity - 1) / granularity * granularity;
+    }
+
+    // Size classes: 64 byte steps below 4 KiB, 4 KiB steps below 2 MiB and huge page steps above.
+    [[nodiscard]] inline std::size_t size_class(std::size_t bytes) {
+        if (bytes < 4096) {
+            return round_up(std::max<std::size_t>(bytes, 1), alignment);
+        }
+        if (bytes < huge_page_size) {
+            return round_up(bytes, 4096);
+        }
+        return round_up(bytes, huge_page_size);
+    }
+
+    [[nodiscard]] inline std::size_t class_alignment(std::size_t class_bytes) {
+        return class_bytes >= huge_page_size ? huge_page_size : alignment;
+    }
+
+    [[nodiscard]] inline void* system_allocate(std::size_t class_bytes) {
+        auto* result = ::operator new(class_bytes, std::align_val_t{ class_alignment(class_bytes) });
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        if (class_bytes >= huge_page_size) {
+            madvise(result, class_bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return result;
+    }
+
+    inline void system_deallocate(void* pointer, std::size_t class_bytes) {
+        ::operator delete(pointer, std::align_val_t{ class_alignment(class_bytes) });
+    }
+
+    [[nodiscard]] inline std::string format_bytes(std::size_t bytes) {
+        if (bytes >= (std::size_t{ 1 } << 30)) {
+            return std::format("{:.2f} GiB", bytes / double(std::size_t{ 1 } << 30));
+        }
+        if (bytes >= (std::size_t{ 1 } << 20)) {
+            return std::format("{:.2f} MiB", bytes / double(std::size_t{ 1 } << 20));
+        }
+        return std::format("{:.2f} KiB", bytes / 1024.0);
+    }
+
+    // Peak resident set size of the process, zero where the system does not report it.
+    [[nodiscard]] inline std::size_t peak_resident_bytes() {
+#ifdef __linux__
+        rusage resources{};
+        if (getrusage(RUSAGE_SELF, &resources) == 0) {
+            return static_cast<std::size_t>(resources.ru_maxrss) * 1024;
+        }
+#endif
+        return 0;
+    }
+
+    class budget_exceeded final : public std::runtime_error {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Bytes handed out by the pool to matrix buffers and scratch arenas. With a budget set an allocation that
+    // would go above it throws budget_exceeded, and operations switch to their low memory variants.
+    class usage final {
+        std::atomic<std::size_t> live{ 0 };
+        std::atomic<std::size_t> peak{ 0 };
+        std::atomic<std::size_t> budget{ 0 };
+
+        usage() = default;
+    public:
+        usage(const usage&) = delete;
+        usage& operator=(const usage&) = delete;
+
+        [[nodiscard]] static usage& instance() {
+            static usage tracker;
+            return tracker;
+        }
+
+        void acquire(std::size_t bytes) {
+            auto now = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+            auto limit = budget.load(std::memory_order_relaxed);
+            if (limit != 0 && now > limit) {
+                live.fetch_sub(bytes, std::memory_order_relaxed);
+                throw budget_exceeded(std::format("Memory budget: allocating {} would exceed the budget of {} ({} in use)",
+                    format_bytes(bytes), format_bytes(limit), format_bytes(now - bytes)));
+            }
+
+            auto previous = peak.load(std::memory_order_relaxed);
+            while (now > previous && !peak.compare_exchange_weak(previous, now, std::memory_order_relaxed)) {
+            }
+        }
+
+        void release(std::size_t bytes) {
+            live.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t live_bytes() const {
+            return live.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t peak_bytes() const {
+            return peak.load(std::memory_order_relaxed);
+        }
+
+        // zero means unlimited
+        void set_budget(std::size_t bytes) {
+            budget.store(bytes, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::size_t budget_bytes() const {
+            return budget.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] bool low_memory() const {
+            return budget_bytes() != 0;
+        }
+
+        // Whether `bytes` more can be taken without going above the budget.
+        [[nodiscard]] bool fits(std::size_t bytes) const {
+            auto limit = budget_bytes();
+            return limit == 0 || live_bytes() + bytes <= limit;
+        }
+    };
+
+    // Process wide cache of released blocks keyed by size class. Steady state workloads that allocate the same
+    // shapes over and over are served from the cache without touching the system allocator.
+    class size_class_pool final {
+        std::mutex mutex;
+        std::unordered_map<std::size_t, std::vector<void*>> free_blocks;
+        std::size_t cached_bytes{ 0 };
+        std::size_t cache_limit{ std::size_t{ 1 } << 30 };
+
+        size_class_pool() = default;
+    public:
+        size_class_pool(const size_class_pool&) = delete;
+        size_class_pool& operator=(const size_class_pool&) = delete;
+
+        // never destroyed, matrices with static storage duration may still release blocks at exit
+        [[nodiscard]] static size_class_pool& instance() {
+            static auto* pool = new size_class_pool();
+            return *pool;
+        }
+
+        [[nodiscard]] void* allocate(std::size_t bytes) {
+            auto class_bytes = size_class(bytes);
+            usage::instance().acquire(class_bytes);
+            MATRICES_PROFILE_COUNT(Allocations, 1);
+            MATRICES_PROFILE_COUNT(AllocatedBytes, class_bytes);
+            {
+                std::lock_guard lock(mutex);
+                if (auto found = free_blocks.find(class_bytes); found != free_blocks.end() && !found->second.empty()) {
+                    auto* result = found->second.back();
+                    found->second.pop_back();
+                    cached_bytes -= class_bytes;
+                    MATRICES_PROFILE_COUNT(PoolHits, 1);
+                    return result;
+                }
+            }
+
+            try {
+                return system_allocate(class_bytes);
+            }
+            catch (...) {
+                usage::instance().release(class_bytes);
+                throw;
+            }
+        }
+
+        void deallocate(void* pointer, std::size_t bytes) {
+            if (pointer == nullptr) {
+                return;
+            }
+
+            auto class_bytes = size_class(bytes);
+            auto& tracker = usage::instance();
+            tracker.release(class_bytes);
+            {
+                std::lock_guard lock(mutex);
+                // under a budget the cache only keeps what still fits in it
+                if (cached_bytes + class_bytes <= cache_limit && tracker.fits(cached_bytes + class_bytes)) {
+                    free_blocks[class_bytes].push_back(pointer);
+                    cached_bytes += class_bytes;
+                    return;
+                }
+            }
+            system_deallocate(pointer, class_bytes);
+        }
+
+        void set_cache_limit(std::size_t bytes) {
+            std::lock_guard lock(mutex);
+            cache_limit = bytes;
+        }
+
+        // Returns every cached block to the system.
+        void release_cached() {
+            std::lock_guard lock(mutex);
+            for (auto& [class_bytes, blocks] : free_blocks) {
+                for (auto* block : blocks) {
+                    system_deallocate(block, class_bytes);
+                }
+            }
+            free_blocks.clear();
+            cached_bytes = 0;
+        }
+    };
+
+    // Default allocator policy of matrix_d: 64 byte aligned, huge page backed for large buffers, pooled.
+    template<typename T>
+    class pool_allocator {
+    public:
+        using value_type = T;
+
+        pool_allocator() = default;
+
+        template<typename U>
+        pool_allocator(const pool_allocator<U>&) noexcept {
+        }
+
+        [[nodiscard]] T* allocate(std::size_t count) {
+            if (count > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+                throw std::bad_array_new_length();
+            }
+            return static_cast<T*>(size_class_pool::instance().allocate(count * sizeof(T)));
+        }
+
+        void deallocate(T* pointer, std::size_t count) noexcept {
+            size_class_pool::instance().deallocate(pointer, count * sizeof(T));
+        }
+
+        // Elements are default initialized: matrix_d zeroes new buffers itself, so that the first touch of the
+        // pages can happen on the threads (and NUMA nodes) that will work on them.
+        template<typename U, typename... Args>
+        void construct(U* pointer, Args&&... args) {
+            if constexpr (sizeof...(Args) == 0) {
+                ::new (static_cast<void*>(pointer)) U;
+            }
+            else {
+                ::new (static_cast<void*>(pointer)) U(std::forward<Args>(args)...);
+            }
+        }
+
+        template<typename U>
+        [[nodiscard]] bool operator==(const pool_allocator<U>&) const noexcept {
+            return true;
+        }
+    };
+
+    // Monotonic per thread scratch memory for temporaries of a single operation. Chunks come from the pool and
+    // are kept for reuse, so repeated operations stop allocating altogether. When the outermost scope of the
+    // thread ends, chunks beyond `retained_bytes` go back to the pool: one large operation does not pin its
+    // scratch memory (and the memory budget) for the rest of the process.
+    class arena final {
+        struct chunk {
+            std::byte* data;
+            std::size_t size;
+        };
+
+        std::vector<chunk> chunks;
+        std::size_t current{ 0 };
+        std::size_t offset{ 0 };
+        std::size_t depth{ 0 };
+
+        static constexpr std::size_t minimal_chunk = std::size_t{ 1 } << 20;
+        static constexpr std::size_t retained_bytes = 4 * minimal_chunk;
+
+        // only called with no scope open, nothing points into the chunks
+        void trim() {
+            std::size_t kept{ 0 };
+            std::vector<chunk> retained;
+            for (auto& item : chunks) {
+                if (kept + item.size <= retained_bytes) {
+                    kept += item.size;
+                    retained.push_back(item);
+                }
+                else {
+                    size_class_pool::instance().deallocate(item.data, item.size);
+                }
+            }
+            chunks = std::move(retained);
+            current = 0;
+            offset = 0;
+        }
+    public:
+        struct position {
+            std::size_t chunk;
+            std::size_t offset;
+        };
+
+        arena() = default;
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        ~arena() {
+            for (auto& item : chunks) {
+                size_class_pool::instance().deallocate(item.data, item.size);
+            }
+        }
+
+        [[nodiscard]] static arena& local() {
+            thread_local arena instance;
+            return instance;
+        }
+
+        [[nodiscard]] void* allocate_bytes(std::size_t bytes) {
+            bytes = round_up(std::max<std::size_t>(bytes, 1), alignment);
+
+            while (current < chunks.size()) {
+                if (offset + bytes <= chunks[current].size) {
+                    auto* result = chunks[current].data + offset;
+                    offset += bytes;
+                    return result;
+                }
+                ++current;
+                offset = 0;
+            }
+
+            auto size = size_class(std::max(bytes, minimal_chunk));
+            chunks.push_back({ static_cast<std::byte*>(size_class_pool::instance().allocate(size)), size });
+            current = chunks.size() - 1;
+            offset = bytes;
+            return chunks.back().data;
+        }
+
+        template<typename T>
+        [[nodiscard]] T* allocate(std::size_t count) {
+            return static_cast<T*>(allocate_bytes(count * sizeof(T)));
+        }
+
+        [[nodiscard]] position mark() const {
+            return { current, offset };
+        }
+
+        void release(const position& mark) {
+            current = mark.chunk;
+            offset = mark.offset;
+        }
+
+        // Scopes nest: enter() returns the position to go back to, leave() releases up to it.
+        [[nodiscard]] position enter() {
+            ++depth;
+            return mark();
+        }
+
+        void leave(const position& start) {
+            release(start);
+            if (--depth == 0) {
+                trim();
+            }
+        }
+    };
+
+    // Scratch allocations of one operation: everything taken through the scope is given back to the thread
+    // arena when the scope ends. Memory is uninitialized and must not outlive the scope.
+    class arena_scope final {
+        arena& owner;
+        arena::position start;
+    public:
+        arena_scope() : owner(arena::local()), start(owner.enter()) {
+        }
+
+        arena_scope(const arena_scope&) = delete;
+        arena_scope& operator=(const arena_scope&) = delete;
+
+        ~arena_scope() {
+            owner.leave(start);
+        }
+
+        template<typename T>
+        [[nodiscard]] T* allocate(std::size_t count) {
+            return owner.allocate<T>(count);
+        }
+    };
+}
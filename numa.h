@@ -0,0 +1,353 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "parallel.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+// NUMA aware placement of large matrix buffers and of the worker threads that process them.
+// The topology is read from /sys/devices/system/node. On a single node machine the behaviour can be checked
+// either with the kernel's emulated nodes (boot with numa=fake=<N>) or by setting MATRICES_NUMA_NODES=<N>,
+// which splits the CPUs into N nodes for thread placement only (memory policies then fall back to defaults).
+namespace matrices::numa {
+    enum class Placement : short {
+        None,
+        Interleave,
+        Partitioned
+    };
+
+    struct settings {
+        Placement placement{ Placement::None };
+        // buffers smaller than this are left to the default policy
+        std::size_t threshold{ std::size_t{ 2 } << 20 };
+    };
+
+    [[nodiscard]] inline settings& current() {
+        static settings instance{};
+        return instance;
+    }
+
+    class topology final {
+        std::vector<std::vector<unsigned int>> node_cpus;
+        std::vector<std::size_t> node_ids;
+        bool emulated{ false };
+
+        [[nodiscard]] static std::vector<unsigned int> parse_cpu_list(const std::string& list) {
+            std::vector<unsigned int> result;
+            std::stringstream ss(list);
+
+            for (std::string range; std::getline(ss, range, ',');) {
+                if (range.empty() || range == "\n") {
+                    continue;
+                }
+
+                auto dash = range.find('-');
+                auto first = static_cast<unsigned int>(std::stoul(range.substr(0, dash)));
+                auto last = dash == std::string::npos ? first : static_cast<unsigned int>(std::stoul(range.substr(dash + 1)));
+                for (auto cpu = first; cpu <= last; ++cpu) {
+                    result.push_back(cpu);
+                }
+            }
+            return result;
+        }
+
+        topology() {
+#ifdef __linux__
+            std::error_code error;
+            const std::filesystem::path nodes_path{ "/sys/devices/system/node" };
+
+            if (std::filesystem::is_directory(nodes_path, error)) {
+                std::vector<std::pair<unsigned int, std::vector<unsigned int>>> found;
+
+                for (const auto& entry : std::filesystem::directory_iterator(nodes_path, error)) {
+                    auto name = entry.path().filename().string();
+                    if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::isdigit(static_cast<unsigned char>(name[4]))) {
+                        continue;
+                    }
+
+                    std::ifstream in(entry.path() / "cpulist");
+                    std::string list;
+                    if (std::getline(in, list)) {
+                        auto cpus = parse_cpu_list(list);
+                        if (!cpus.empty()) {
+                            found.emplace_back(static_cast<unsigned int>(std::stoul(name.substr(4))), std::move(cpus));
+                        }
+                    }
+                }
+
+                std::sort(std::begin(found), std::end(found));
+                for (auto& [node, cpus] : found) {
+                    node_ids.push_back(node);
+                    node_cpus.push_back(std::move(cpus));
+                }
+            }
+#endif
+            if (node_cpus.empty()) {
+                std::vector<unsigned int> cpus(utility::hardware_threads());
+                for (unsigned int cpu = 0; cpu < cpus.size(); ++cpu) {
+                    cpus[cpu] = cpu;
+                }
+                node_cpus.push_back(std::move(cpus));
+                node_ids.push_back(0);
+            }
+
+            if (const char* value = std::getenv("MATRICES_NUMA_NODES"); value != nullptr) {
+                emulate(static_cast<std::size_t>(std::strtoul(value, nullptr, 10)));
+            }
+        }
+
+        void emulate(std::size_t nodes) {
+            std::vector<unsigned int> cpus;
+            for (auto& node : node_cpus) {
+                cpus.insert(std::end(cpus), std::begin(node), std::end(node));
+            }
+
+            nodes = std::max<std::size_t>(nodes, 1);
+            node_cpus.assign(nodes, {});
+            node_ids.assign(nodes, 0);
+
+            if (nodes <= cpus.size()) {
+                for (std::size_t index = 0; index < cpus.size(); ++index) {
+                    node_cpus[index * nodes / cpus.size()].push_back(cpus[index]);
+                }
+            }
+            else {
+                // more emulated nodes than CPUs: nodes share CPUs round robin
+                for (std::size_t node = 0; node < nodes; ++node) {
+                    node_cpus[node].push_back(cpus[node % cpus.size()]);
+                }
+            }
+
+            for (std::size_t node = 0; node < nodes; ++node) {
+                node_ids[node] = node;
+            }
+            emulated = true;
+        }
+    public:
+        [[nodiscard]] static topology& instance() {
+            static topology value;
+            return value;
+        }
+
+        [[nodiscard]] std::size_t nodes_count() const {
+            return node_cpus.size();
+        }
+
+        [[nodiscard]] const std::vector<unsigned int>& cpus(std::size_t node) const {
+            return node_cpus.at(node);
+        }
+
+        // kernel node number of the node at `index`
+        [[nodiscard]] std::size_t node_id(std::size_t index) const {
+            return node_ids.at(index);
+        }
+
+        [[nodiscard]] std::size_t cpus_count() const {
+            std::size_t result{ 0 };
+            for (const auto& node : node_cpus) {
+                result += node.size();
+            }
+            return result;
+        }
+
+        [[nodiscard]] bool is_emulated() const {
+            return emulated;
+        }
+
+        // First index of `node`'s share of [0, count), shares are proportional to the CPUs of each node.
+        [[nodiscard]] std::size_t partition_begin(std::size_t node, std::size_t count) const {
+            std::size_t cpus_before{ 0 };
+            for (std::size_t index = 0; index < node; ++index) {
+                cpus_before += node_cpus[index].size();
+            }
+            return static_cast<std::size_t>(static_cast<unsigned long long>(count) * cpus_before / cpus_count());
+        }
+    };
+
+    [[nodiscard]] inline bool enabled() {
+        return current().placement != Placement::None;
+    }
+
+    inline void pin_current_thread(std::size_t node) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto cpu : topology::instance().cpus(node)) {
+            if (cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        sched_setaffinity(0, sizeof(set), &set);
+#else
+        (void)node;
+#endif
+    }
+
+    // Applies the memory policy for the given node indices to the pages of [pointer, pointer + bytes). Failures (no NUMA support in the
+    // kernel, emulated nodes) silently keep the default policy.
+    inline void bind_memory(void* pointer, std::size_t bytes, const std::vector<std::size_t>& nodes, bool interleave) {
+#if defined(__linux__) && defined(SYS_mbind)
+        if (topology::instance().is_emulated() || nodes.empty()) {
+            return;
+        }
+
+        constexpr int policy_bind = 2;
+        constexpr int policy_interleave = 3;
+        constexpr unsigned int move_pages = 1u << 1;
+
+        auto page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+        auto first = reinterpret_cast<std::uintptr_t>(pointer) / page * page;
+        auto last = (reinterpret_cast<std::uintptr_t>(pointer) + bytes + page - 1) / page * page;
+        if (first >= last) {
+            return;
+        }
+
+        unsigned long mask[16]{};
+        constexpr std::size_t bits = sizeof(unsigned long) * 8;
+        for (auto index : nodes) {
+            auto node = topology::instance().node_id(index);
+            if (node < std::size(mask) * bits) {
+                mask[node / bits] |= 1ul << (node % bits);
+            }
+        }
+
+        syscall(SYS_mbind, first, last - first, interleave ? policy_interleave : policy_bind, mask, std::size(mask) * bits, move_pages);
+#else
+        (void)pointer;
+        (void)bytes;
+        (void)nodes;
+        (void)interleave;
+#endif
+    }
+
+    // Runs function(node, first, last) over [0, count) with every node's share processed by threads pinned to
+    // that node. Within a node chunks of `grain` are handed out dynamically.
+    template<typename Function>
+    void parallel_for_nodes(std::size_t count, std::size_t grain, Function&& function) {
+        const auto& layout = topology::instance();
+        grain = std::max<std::size_t>(grain, 1);
+
+        std::exception_ptr error{ nullptr };
+        std::mutex error_mutex;
+        std::vector<std::thread> threads;
+        MATRICES_PROFILE_COUNT(ParallelRegions, 1);
+
+        for (std::size_t node = 0; node < layout.nodes_count(); ++node) {
+            auto node_first = layout.partition_begin(node, count);
+            auto node_last = node + 1 < layout.nodes_count() ? layout.partition_begin(node + 1, count) : count;
+            if (node_first >= node_last) {
+                continue;
+            }
+
+            auto chunks = (node_last - node_first + grain - 1) / grain;
+            auto workers = std::min(layout.cpus(node).size(), chunks);
+            auto next_chunk = std::make_shared<std::atomic<std::size_t>>(0);
+            MATRICES_PROFILE_COUNT(Tasks, chunks);
+            MATRICES_PROFILE_COUNT(Threads, workers);
+
+            for (std::size_t worker = 0; worker < workers; ++worker) {
+                threads.emplace_back([&, node, node_first, node_last, chunks, next_chunk]() {
+                    try {
+                        pin_current_thread(node);
+                        for (auto chunk = (*next_chunk)++; chunk < chunks; chunk = (*next_chunk)++) {
+                            auto chunk_first = node_first + chunk * grain;
+                            function(node, chunk_first, std::min(chunk_first + grain, node_last));
+                        }
+                    }
+                    catch (...) {
+                        std::lock_guard lock(error_mutex);
+                        if (!error) {
+                            error = std::current_exception();
+                        }
+                    }
+                });
+            }
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Row parallel loop used by the kernels: node aware when a placement is selected, plain otherwise.
+    template<typename Function>
+    void parallel_for(std::size_t first, std::size_t last, std::size_t grain, Function&& function) {
+        if (!enabled() || topology::instance().nodes_count() < 2 || first >= last) {
+            utility::parallel_for(first, last, grain, function);
+            return;
+        }
+
+        parallel_for_nodes(last - first, grain, [&](std::size_t, std::size_t chunk_first, std::size_t chunk_last) {
+            function(first + chunk_first, first + chunk_last);
+        });
+    }
+
+    // Places and zero initializes a freshly allocated rows x row_size buffer. With the partitioned placement the
+    // rows are first touched by threads pinned to the node that later computes them, with interleaving the
+    // pages are spread round robin over all nodes.
+    template<typename T>
+    void first_touch(T* values, std::size_t rows, std::size_t row_size) {
+        const auto count = rows * row_size;
+        const auto bytes = count * sizeof(T);
+
+        if (!enabled() || bytes < current().threshold || values == nullptr) {
+            std::fill(values, values + count, T{});
+            return;
+        }
+
+        const auto& layout = topology::instance();
+
+        if (current().placement == Placement::Interleave) {
+            std::vector<std::size_t> nodes(layout.nodes_count());
+            for (std::size_t node = 0; node < nodes.size(); ++node) {
+                nodes[node] = node;
+            }
+            bind_memory(values, bytes, nodes, true);
+        }
+        else {
+            for (std::size_t node = 0; node < layout.nodes_count(); ++node) {
+                auto row_first = layout.partition_begin(node, rows);
+                auto row_last = node + 1 < layout.nodes_count() ? layout.partition_begin(node + 1, rows) : rows;
+                bind_memory(values + row_first * row_size, (row_last - row_first) * row_size * sizeof(T), { node }, false);
+            }
+        }
+
+        parallel_for_nodes(rows, 16, [&](std::size_t, std::size_t first, std::size_t last) {
+            std::fill(values + first * row_size, values + last * row_size, T{});
+        });
+    }
+}
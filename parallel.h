@@ -0,0 +1,95 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+#include "tuning.h"
+
+namespace utility {
+    // Workers of the parallel loops: the tuned thread count, every hardware thread by default.
+    [[nodiscard]] inline std::size_t hardware_threads() {
+        if (auto configured = matrices::tuning::current().threads; configured != 0) {
+            return configured;
+        }
+
+        auto count = std::thread::hardware_concurrency();
+        return count == 0 ? 1 : static_cast<std::size_t>(count);
+    }
+
+    // Runs function(chunk_first, chunk_last) over [first, last) split into chunks of `grain` iterations.
+    // Chunks are handed out dynamically, so uneven work per iteration is balanced between workers.
+    // The first exception thrown by a worker is rethrown on the calling thread.
+    template<typename Function>
+    void parallel_for(std::size_t first, std::size_t last, std::size_t grain, Function&& function) {
+        if (first >= last) {
+            return;
+        }
+
+        grain = std::max<std::size_t>(grain, 1);
+        auto chunks = (last - first + grain - 1) / grain;
+        auto workers_count = std::min(hardware_threads(), chunks);
+
+        MATRICES_PROFILE_COUNT(ParallelRegions, 1);
+        if (workers_count <= 1) {
+            MATRICES_PROFILE_COUNT(Tasks, 1);
+            function(first, last);
+            return;
+        }
+
+        MATRICES_PROFILE_COUNT(Tasks, chunks);
+        MATRICES_PROFILE_COUNT(Threads, workers_count - 1);
+
+        std::atomic<std::size_t> next_chunk{ 0 };
+        std::exception_ptr error{ nullptr };
+        std::mutex error_mutex;
+
+        auto worker = [&]() {
+            try {
+                for (auto chunk = next_chunk++; chunk < chunks; chunk = next_chunk++) {
+                    auto chunk_first = first + chunk * grain;
+                    function(chunk_first, std::min(chunk_first + grain, last));
+                }
+            }
+            catch (...) {
+                std::lock_guard lock(error_mutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next_chunk = chunks;
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(workers_count - 1);
+        for (std::size_t index = 1; index < workers_count; ++index) {
+            threads.emplace_back(worker);
+        }
+        worker();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace utility {
+    // Brain floating point: the upper half of an IEEE-754 binary32 (8 exponent bits, 7 mantissa bits).
+    // Used only as a storage format, all arithmetic is done after widening to float.
+    class bfloat16 final {
+        std::uint16_t bits{ 0 };
+
+        [[nodiscard]] static std::uint16_t from_float(float value) {
+            auto raw = std::bit_cast<std::uint32_t>(value);
+
+            if (std::isnan(value)) {
+                return static_cast<std::uint16_t>((raw >> 16) | 0x0040u);
+            }
+
+            // round to nearest, ties to even
+            raw += 0x7FFFu + ((raw >> 16) & 1u);
+            return static_cast<std::uint16_t>(raw >> 16);
+        }
+    public:
+        constexpr bfloat16() = default;
+
+        template<typename U> requires std::is_arithmetic_v<U>
+        bfloat16(const U& value) : bits(from_float(static_cast<float>(value))) {
+        }
+
+        [[nodiscard]] operator float() const {
+            return std::bit_cast<float>(static_cast<std::uint32_t>(bits) << 16);
+        }
+
+        [[nodiscard]] std::uint16_t raw_bits() const {
+            return bits;
+        }
+
+        [[nodiscard]] bool operator==(const bfloat16& other) const {
+            return static_cast<float>(*this) == static_cast<float>(other);
+        }
+    };
+
+    template<typename T>
+    concept LowPrecision = std::is_same_v<T, bfloat16>;
+
+    template<typename T>
+    concept Element = std::is_arithmetic_v<T> || LowPrecision<T>;
+
+    template<Element T>
+    struct accumulator {
+        using type = T;
+    };
+
+    template<>
+    struct accumulator<bfloat16> {
+        using type = float;
+    };
+
+    template<>
+    struct accumulator<float> {
+        using type = double;
+    };
+
+    template<Element T> requires (std::is_integral_v<T> && sizeof(T) <= sizeof(std::int16_t))
+    struct accumulator<T> {
+        using type = std::int32_t;
+    };
+
+    template<Element T>
+    using accumulator_t = typename accumulator<T>::type;
+
+    template<Element T>
+    inline constexpr int storage_digits = LowPrecision<T> ? 8 : std::numeric_limits<T>::digits;
+
+    template<typename Storage, typename Accumulator>
+    concept widening_accumulator = Element<Storage> && std::is_arithmetic_v<Accumulator> &&
+        (std::is_integral_v<Storage> == std::is_integral_v<Accumulator>) &&
+        (std::numeric_limits<Accumulator>::digits >= storage_digits<Storage>);
+
+    // Converts between element types. Narrowing from floating point to integer storage rounds
+    // to nearest and saturates instead of invoking undefined behaviour on out of range values.
+    template<Element To, Element From>
+    [[nodiscard]] inline To convert(const From& value) {
+        if constexpr (std::is_integral_v<To> && !std::is_integral_v<From>) {
+            auto rounded = std::nearbyint(static_cast<double>(value));
+            if (std::isnan(rounded)) {
+                return To{ 0 };
+            }
+            if (rounded <= static_cast<double>(std::numeric_limits<To>::lowest())) {
+                return std::numeric_limits<To>::lowest();
+            }
+            if (rounded >= static_cast<double>(std::numeric_limits<To>::max())) {
+                return std::numeric_limits<To>::max();
+            }
+            return static_cast<To>(rounded);
+        }
+        else if constexpr (LowPrecision<From>) {
+            return static_cast<To>(static_cast<float>(value));
+        }
+        else {
+            return static_cast<To>(value);
+        }
+    }
+}
@@ -0,0 +1,254 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Scoped timers and counters behind MATRICES_PROFILE_SCOPE and MATRICES_PROFILE_COUNT. Without the
+// MATRICES_PROFILE define both macros expand to nothing and their arguments are not evaluated, with it they
+// cost one relaxed atomic load while no session is started (--profile).
+namespace matrices::profiler {
+#ifdef MATRICES_PROFILE
+    inline constexpr bool compiled_in = true;
+#else
+    inline constexpr bool compiled_in = false;
+#endif
+
+    enum class Counter : short {
+        Flops,
+        Bytes,
+        Allocations,
+        AllocatedBytes,
+        PoolHits,
+        ParallelRegions,
+        Tasks,
+        Threads,
+        Count
+    };
+
+    inline constexpr std::array<const char*, static_cast<std::size_t>(Counter::Count)> counter_names{
+        "flops", "bytes moved", "allocations", "allocated bytes", "pool hits", "parallel regions", "tasks", "threads spawned" };
+
+    struct event {
+        const char* name;
+        const char* category;
+        std::uint32_t thread;
+        std::int64_t start_ns;
+        std::int64_t duration_ns;
+    };
+
+    class session final {
+        using clock = std::chrono::steady_clock;
+
+        // keeps a runaway kernel loop from exhausting memory, the totals are still accumulated
+        static constexpr std::size_t events_limit = std::size_t{ 1 } << 20;
+
+        struct totals {
+            std::string category;
+            std::uint64_t calls{ 0 };
+            std::int64_t duration_ns{ 0 };
+        };
+
+        std::atomic<bool> enabled{ false };
+        std::array<std::atomic<std::uint64_t>, static_cast<std::size_t>(Counter::Count)> counters{};
+        std::atomic<std::uint32_t> threads_count{ 0 };
+        clock::time_point start_time{ clock::now() };
+
+        std::mutex mutex;
+        std::vector<event> events;
+        std::map<std::string, totals> scopes;
+        std::uint64_t dropped_events{ 0 };
+
+        session() = default;
+    public:
+        session(const session&) = delete;
+        session& operator=(const session&) = delete;
+
+        [[nodiscard]] static session& instance() {
+            static session profile;
+            return profile;
+        }
+
+        void start() {
+            std::lock_guard lock(mutex);
+            events.clear();
+            scopes.clear();
+            dropped_events = 0;
+            for (auto& counter : counters) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+            start_time = clock::now();
+            enabled.store(true, std::memory_order_release);
+        }
+
+        void stop() {
+            enabled.store(false, std::memory_order_release);
+        }
+
+        [[nodiscard]] bool is_enabled() const {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::int64_t now_ns() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start_time).count();
+        }
+
+        // small stable thread numbers for the trace viewer
+        [[nodiscard]] std::uint32_t thread_id() {
+            thread_local std::uint32_t id = threads_count++;
+            return id;
+        }
+
+        void add(Counter counter, std::uint64_t value) {
+            if (is_enabled()) {
+                counters[static_cast<std::size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+            }
+        }
+
+        [[nodiscard]] std::uint64_t get(Counter counter) const {
+            return counters[static_cast<std::size_t>(counter)].load(std::memory_order_relaxed);
+        }
+
+        void record(const event& item) {
+            std::lock_guard lock(mutex);
+            auto& total = scopes[item.name];
+            total.category = item.category;
+            ++total.calls;
+            total.duration_ns += item.duration_ns;
+
+            if (events.size() < events_limit) {
+                events.push_back(item);
+            }
+            else {
+                ++dropped_events;
+            }
+        }
+
+        void summary(std::ostream& out) {
+            std::lock_guard lock(mutex);
+            auto wall_ns = now_ns();
+
+            out << std::format("Profile ({:.3f} ms wall time)\n", wall_ns / 1e6);
+            for (const char* category : { "phase", "kernel" }) {
+                for (const auto& [name, total] : scopes) {
+                    if (total.category != category) {
+                        continue;
+                    }
+                    out << std::format("  {:<8} {:<20} {:>8} call(s) {:>12.3f} ms {:>6.1f}%\n", category, name, total.calls,
+                        total.duration_ns / 1e6, wall_ns > 0 ? 100.0 * total.duration_ns / wall_ns : 0.0);
+                }
+            }
+
+            for (std::size_t index = 0; index < counters.size(); ++index) {
+                out << std::format("  {:<20} {}\n", counter_names[index], counters[index].load(std::memory_order_relaxed));
+            }
+
+            // rates are relative to the time spent inside the kernels, which are never nested
+            std::int64_t kernels_ns{ 0 };
+            for (const auto& [name, total] : scopes) {
+                if (total.category == std::string("kernel")) {
+                    kernels_ns += total.duration_ns;
+                }
+            }
+            if (kernels_ns > 0) {
+                out << std::format("  kernels: {:.3f} GFLOP/s, {:.3f} GB/s\n", get(Counter::Flops) / static_cast<double>(kernels_ns),
+                    get(Counter::Bytes) / static_cast<double>(kernels_ns));
+            }
+            if (dropped_events > 0) {
+                out << std::format("  {} event(s) were not kept for the trace\n", dropped_events);
+            }
+        }
+
+        // Chrome trace event format, opens in chrome://tracing and Perfetto
+        void write_chrome_trace(const std::filesystem::path& path) {
+            std::ofstream file(path);
+            if (!file.is_open()) {
+                throw std::runtime_error("Unable to open file for writting");
+            }
+
+            std::lock_guard lock(mutex);
+            file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+            for (const auto& item : events) {
+                file << std::format("{{\"name\": \"{}\", \"cat\": \"{}\", \"ph\": \"X\", \"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": 1, \"tid\": {}}},\n",
+                    item.name, item.category, item.start_ns / 1e3, item.duration_ns / 1e3, item.thread);
+            }
+
+            file << "{\"name\": \"counters\", \"ph\": \"C\", \"ts\": 0, \"pid\": 1, \"args\": {";
+            for (std::size_t index = 0; index < counters.size(); ++index) {
+                file << std::format("{}\"{}\": {}", index == 0 ? "" : ", ", counter_names[index], counters[index].load(std::memory_order_relaxed));
+            }
+            file << "}}\n]}\n";
+        }
+    };
+
+    inline void count(Counter counter, std::uint64_t value) {
+        session::instance().add(counter, value);
+    }
+
+    // Records the lifetime of the object as one event.
+    class scope final {
+        const char* name;
+        const char* category;
+        std::int64_t start_ns{ -1 };
+    public:
+        scope(const char* name, const char* category) : name(name), category(category) {
+            auto& profile = session::instance();
+            if (profile.is_enabled()) {
+                start_ns = profile.now_ns();
+            }
+        }
+
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+
+        ~scope() {
+            auto& profile = session::instance();
+            if (start_ns >= 0 && profile.is_enabled()) {
+                profile.record({ name, category, profile.thread_id(), start_ns, profile.now_ns() - start_ns });
+            }
+        }
+    };
+}
+
+#define MATRICES_PROFILE_CONCAT_IMPL(left, right) left##right
+#define MATRICES_PROFILE_CONCAT(left, right) MATRICES_PROFILE_CONCAT_IMPL(left, right)
+
+#ifdef MATRICES_PROFILE
+#define MATRICES_PROFILE_SCOPE(name, category) ::matrices::profiler::scope MATRICES_PROFILE_CONCAT(matrices_profile_scope_, __LINE__)(name, category)
+#define MATRICES_PROFILE_COUNT(counter, value) ::matrices::profiler::count(::matrices::profiler::Counter::counter, static_cast<std::uint64_t>(value))
+#else
+#define MATRICES_PROFILE_SCOPE(name, category) ((void)0)
+#define MATRICES_PROFILE_COUNT(counter, value) ((void)0)
+#endif
+
+namespace matrices::profiler {
+    // Runs function() as one phase of the program and returns its result.
+    template<typename Function>
+    decltype(auto) phase([[maybe_unused]] const char* name, Function&& function) {
+        MATRICES_PROFILE_SCOPE(name, "phase");
+        return function();
+    }
+}
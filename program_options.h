@@ -17,6 +17,11 @@
 #include <algorithm>
 
 #include "serializer.h"
+#include "async.h"
+#include "autotune.h"
+#include "generator.h"
+#include "streaming.h"
+#include "sharded.h"
 
 #include "boost/program_options.hpp"
 namespace matrices::program_options {
@@ -28,35 +33,266 @@ namespace matrices::program_options {
         Traspose,
         Invert,
         Submatrix,
-        At
+        At,
+        Solve,
+        Chain,
+        Power,
+        Cholesky,
+        QR,
+        CholeskySolve,
+        LeastSquares,
+        Eigen,
+        SVD,
+        Sum,
+        Norm,
+        Trace,
+        Min,
+        Max,
+        Dot,
+        Hadamard,
+        Autotune,
+        Generate,
+        Apply
     };
 
+    enum class Precision : short {
+        Unknown,
+        Double,
+        Float,
+        BFloat16,
+        Int16,
+        Int8
+    };
+
+    enum class Algorithm : short {
+        Unknown,
+        Classic,
+        Strassen
+    };
+
+    struct multiply_options {
+        Precision precision{ Precision::Double };
+        Algorithm algorithm{ Algorithm::Classic };
+        std::uint32_t strassen_crossover{ 256 };
+        bool report_accuracy{ false };
+    };
+
+    void report_accuracy(const matrices::matrix_d<double>& result, const matrices::matrix_d<double>& reference) {
+        double max_error{ 0.0 }, error_norm{ 0.0 }, reference_norm{ 0.0 };
+
+        for (std::uint32_t ri = 0; ri < reference.get_rows_count(); ++ri) {
+            for (std::uint32_t ci = 0; ci < reference.get_columns_count(); ++ci) {
+                auto error = result(ri, ci) - reference(ri, ci);
+                max_error = std::max(max_error, std::abs(error));
+                error_norm += error * error;
+                reference_norm += reference(ri, ci) * reference(ri, ci);
+            }
+        }
+
+        auto relative_error = reference_norm > 0.0 ? std::sqrt(error_norm / reference_norm) : std::sqrt(error_norm);
+        std::cout << std::format("Accuracy against the classic product: max abs error {}, relative Frobenius error {}\n", max_error, relative_error);
+    }
+
+    // The operands are parsed straight into the storage type, no double copy of them is ever held.
+    template<typename Storage>
+    matrices::matrix_d<double> multiply_with_storage(const std::filesystem::path& first_matrix_path, const std::filesystem::path& second_matrix_path) {
+        auto first_storage = matrices::serialize::from_csv_mapped<Storage>(first_matrix_path);
+        auto second_storage = matrices::serialize::from_csv_mapped<Storage>(second_matrix_path);
+
+        return matrices::profiler::phase("compute", [&]() { return first_storage.multiply_mixed(second_storage).template cast<double>(); });
+    }
+
+    matrices::matrix_d<double> multiply_in_precision(const std::filesystem::path& first_matrix_path, const std::filesystem::path& second_matrix_path, const Precision& precision) {
+        switch (precision)
+        {
+        case Precision::Float:
+            return multiply_with_storage<float>(first_matrix_path, second_matrix_path);
+        case Precision::BFloat16:
+            return multiply_with_storage<utility::bfloat16>(first_matrix_path, second_matrix_path);
+        case Precision::Int16:
+            return multiply_with_storage<std::int16_t>(first_matrix_path, second_matrix_path);
+        case Precision::Int8:
+            return multiply_with_storage<std::int8_t>(first_matrix_path, second_matrix_path);
+        case Precision::Double:
+        default:
+            return multiply_with_storage<double>(first_matrix_path, second_matrix_path);
+        }
+    }
+
     bool matrix_with_scalar(const std::filesystem::path& result_path, const std::filesystem::path& first_matrix_path, const Operation& operation, const double& scalar) {
         try {
             auto first_matrix = matrices::serialize::from_csv(first_matrix_path);
             matrices::matrix_d<double> result_matrix;
-            switch (operation)
             {
-            case Operation::Add: {
-                result_matrix = first_matrix + scalar;
-                break;
+                MATRICES_PROFILE_SCOPE("compute", "phase");
+                switch (operation)
+                {
+                case Operation::Add: {
+                    result_matrix = first_matrix + scalar;
+                    break;
+                }
+                case Operation::Subtract: {
+                    result_matrix = first_matrix - scalar;
+                    break;
+                }
+                case Operation::Multiply: {
+                    result_matrix = first_matrix * scalar;
+                    break;
+                }
+                case Operation::At: {
+                    // validated as a double: a negative or fractional index must not wrap around in the conversion
+                    const auto size = static_cast<double>(first_matrix.get_rows_count()) * first_matrix.get_columns_count();
+                    if (!(scalar >= 0.0 && scalar < size) || scalar != std::floor(scalar)) {
+                        throw std::runtime_error("At operation: the index must be an integer in [0, rows * columns)");
+                    }
+                    result_matrix = matrices::matrix_d<double>(1, 1, { first_matrix.at(static_cast<std::uint32_t>(scalar)) });
+                    break;
+                }
+                default:
+                    return false;
+                    break;
+                }
             }
-            case Operation::Subtract: {
-                result_matrix = first_matrix - scalar;
-                break;
+            matrices::serialize::to_csv(result_path, result_matrix, ',');
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool matrix_power(const std::filesystem::path& result_path, const std::filesystem::path& first_matrix_path, const double& exponent) {
+        try {
+            if (exponent < 0.0 || exponent != std::floor(exponent)) {
+                throw std::runtime_error("Power operation: the exponent must be a non-negative integer");
             }
-            case Operation::Multiply: {
-                result_matrix = first_matrix * scalar;
-                break;
+
+            auto first_matrix = matrices::serialize::from_csv(first_matrix_path);
+            auto result_matrix = matrices::profiler::phase("compute", [&]() { return first_matrix.power(static_cast<std::uint64_t>(exponent)); });
+            matrices::serialize::to_csv(result_path, result_matrix, ',');
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool spectral_estimate(const std::filesystem::path& result_path, const std::filesystem::path& first_matrix_path, const Operation& operation,
+        const matrices::spectral::options& settings) {
+        try {
+            auto first_matrix = matrices::serialize::from_csv(first_matrix_path);
+
+            auto print_values = [](const char* title, const std::vector<double>& values, std::size_t iterations, bool converged) {
+                std::cout << title << ":";
+                for (auto value : values) {
+                    std::cout << std::format(" {}", value);
+                }
+                std::cout << std::format(" ({} after {} iterations)\n", converged ? "converged" : "not converged", iterations);
+            };
+
+            if (operation == Operation::Eigen) {
+                auto estimate = matrices::profiler::phase("compute", [&]() { return matrices::spectral::eigenvalues(first_matrix, settings); });
+                print_values("Eigenvalues", estimate.values, estimate.iterations, estimate.converged);
+                matrices::serialize::to_csv(result_path, estimate.vectors, ',');
             }
-            case Operation::At: {
-                result_matrix = matrices::matrix_d<double>(1, 1, { first_matrix[scalar] });
-                break;
+            else {
+                // left singular vectors go to the result file, right ones next to it as <name>_v<extension>
+                auto estimate = matrices::profiler::phase("compute", [&]() { return matrices::spectral::svd(first_matrix, settings); });
+                print_values("Singular values", estimate.values, estimate.iterations, estimate.converged);
+
+                auto right_path = result_path;
+                right_path.replace_filename(result_path.stem().string() + "_v" + result_path.extension().string());
+                matrices::serialize::to_csv(right_path, estimate.right, ',');
+                matrices::serialize::to_csv(result_path, estimate.left, ',');
             }
-            default:
-                return false;
-                break;
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Scalar results are printed instead of being written to a file.
+    bool reduce(const std::filesystem::path& first_matrix_path, const std::filesystem::path& second_matrix_path, const Operation& operation) {
+        try {
+            if (operation == Operation::Dot && second_matrix_path.empty()) {
+                throw std::runtime_error("Dot operation: the operand matrix is required");
+            }
+
+            // both operands are parsed concurrently
+            auto first_loaded = matrices::async::load_csv(first_matrix_path);
+            matrices::async::task<matrices::matrix_d<double>> second_loaded;
+            if (operation == Operation::Dot) {
+                second_loaded = matrices::async::load_csv(second_matrix_path);
+            }
+
+            const auto& first_matrix = first_loaded.get();
+
+            double result{ 0.0 };
+            {
+                MATRICES_PROFILE_SCOPE("compute", "phase");
+                switch (operation)
+                {
+                case Operation::Sum: {
+                    result = first_matrix.sum();
+                    break;
+                }
+                case Operation::Norm: {
+                    result = first_matrix.frobenius_norm();
+                    break;
+                }
+                case Operation::Trace: {
+                    result = first_matrix.trace();
+                    break;
+                }
+                case Operation::Min: {
+                    result = first_matrix.min();
+                    break;
+                }
+                case Operation::Max: {
+                    result = first_matrix.max();
+                    break;
+                }
+                case Operation::Dot: {
+                    result = first_matrix.dot(second_loaded.get());
+                    break;
+                }
+                default:
+                    return false;
+                    break;
+                }
             }
+            std::cout << std::format("{}\n", result);
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool chain_product(const std::filesystem::path& result_path, const std::vector<std::filesystem::path>& matrix_paths) {
+        try {
+            // parsed concurrently, copying the loaded matrices out of the tasks only shares their elements
+            std::vector<matrices::async::task<matrices::matrix_d<double>>> loading;
+            for (const auto& path : matrix_paths) {
+                loading.push_back(matrices::async::load_csv(path));
+            }
+
+            std::vector<matrices::matrix_d<double>> operands;
+            for (auto& operand : loading) {
+                operands.push_back(operand.get());
+            }
+
+            auto dimensions = matrices::chain::dimensions(operands);
+            matrices::chain::plan order(dimensions);
+            std::cout << std::format("Chain order: {} ({} scalar multiplications, left to right {})\n",
+                order.to_string(), order.cost(), matrices::chain::left_to_right_cost(dimensions));
+
+            auto result_matrix = matrices::profiler::phase("compute", [&]() { return matrices::chain::multiply(operands, order, 0, operands.size() - 1); });
             matrices::serialize::to_csv(result_path, result_matrix, ',');
         }
         catch (std::exception& e) {
@@ -70,7 +306,9 @@ namespace matrices::program_options {
         const std::pair<std::uint32_t, std::uint32_t>& counts, const std::pair<std::uint32_t, std::uint32_t>& starts) {
         try {
             auto first_matrix = matrices::serialize::from_csv(first_matrix_path);
-            matrices::matrix_d<double> result_matrix = first_matrix.submatrix(std::get<0>(counts), std::get<1>(counts), std::get<0>(starts), std::get<1>(starts));
+            auto result_matrix = matrices::profiler::phase("compute", [&]() {
+                return first_matrix.submatrix(std::get<0>(counts), std::get<1>(counts), std::get<0>(starts), std::get<1>(starts));
+            });
             matrices::serialize::to_csv(result_path, result_matrix, ',');
         }
         catch (std::exception& e) {
@@ -87,11 +325,25 @@ namespace matrices::program_options {
             switch (operation)
             {
             case Operation::Invert: {
-                result_matrix = first_matrix.inverse();
+                result_matrix = matrices::profiler::phase("compute", [&]() { return first_matrix.inverse(); });
                 break;
             }
             case Operation::Traspose: {
-                result_matrix = first_matrix.transpose();
+                matrices::profiler::phase("compute", [&]() { first_matrix.transpose_in_place(); });
+                result_matrix = std::move(first_matrix);
+                break;
+            }
+            case Operation::Cholesky: {
+                result_matrix = matrices::profiler::phase("compute", [&]() { return first_matrix.cholesky(); });
+                break;
+            }
+            case Operation::QR: {
+                // R goes to the result file, Q next to it as <name>_q<extension>
+                auto [q, r] = matrices::profiler::phase("compute", [&]() { return first_matrix.qr(); });
+                auto q_path = result_path;
+                q_path.replace_filename(result_path.stem().string() + "_q" + result_path.extension().string());
+                matrices::serialize::to_csv(q_path, q, ',');
+                result_matrix = std::move(r);
                 break;
             }
             default:
@@ -107,30 +359,329 @@ namespace matrices::program_options {
         return true;
     }
 
-    bool matrix_with_matrix(const std::filesystem::path& result_path, const std::filesystem::path& first_matrix_path, const std::filesystem::path& second_matrix_path, const Operation& operation) {
+    matrices::matrix_d<double> multiply(const matrices::matrix_d<double>& first_matrix, const matrices::matrix_d<double>& second_matrix, const multiply_options& options) {
+        if (options.algorithm != Algorithm::Strassen) {
+            return first_matrix * second_matrix;
+        }
+
+        auto result = first_matrix.multiply_strassen(second_matrix, options.strassen_crossover);
+        if (options.report_accuracy) {
+            report_accuracy(result, first_matrix * second_matrix);
+        }
+        return result;
+    }
+
+    bool matrix_with_matrix(const std::filesystem::path& result_path, const std::filesystem::path& first_matrix_path, const std::filesystem::path& second_matrix_path, const Operation& operation, const multiply_options& options) {
         try {
-            auto first_matrix = matrices::serialize::from_csv(first_matrix_path);
-            auto second_matrix = matrices::serialize::from_csv(second_matrix_path);
+            if (operation == Operation::Multiply && options.precision != Precision::Double) {
+                auto result_matrix = multiply_in_precision(first_matrix_path, second_matrix_path, options.precision);
+                matrices::serialize::to_csv(result_path, result_matrix, ',');
+                return true;
+            }
+
+            // both operands are parsed concurrently
+            auto first_loaded = matrices::async::load_csv(first_matrix_path);
+            auto second_loaded = matrices::async::load_csv(second_matrix_path);
+
+            if (operation == Operation::Multiply && options.algorithm == Algorithm::Classic && !options.report_accuracy) {
+                // rows are written out while the following row blocks are still being multiplied
+                matrices::async::multiply_to_csv(result_path, first_loaded, second_loaded).get();
+                return true;
+            }
+
+            const auto& first_matrix = first_loaded.get();
+            const auto& second_matrix = second_loaded.get();
             matrices::matrix_d<double> result_matrix;
-            switch (operation)
             {
-            case Operation::Add: {
-                result_matrix = first_matrix + second_matrix;
-                break;
+                MATRICES_PROFILE_SCOPE("compute", "phase");
+                switch (operation)
+                {
+                case Operation::Add: {
+                    result_matrix = first_matrix + second_matrix;
+                    break;
+                }
+                case Operation::Subtract: {
+                    result_matrix = first_matrix - second_matrix;
+                    break;
+                }
+                case Operation::Multiply: {
+                    result_matrix = multiply(first_matrix, second_matrix, options);
+                    break;
+                }
+                case Operation::Solve: {
+                    result_matrix = first_matrix.solve(second_matrix);
+                    break;
+                }
+                case Operation::Hadamard: {
+                    result_matrix = first_matrix.hadamard(second_matrix);
+                    break;
+                }
+                case Operation::CholeskySolve: {
+                    result_matrix = first_matrix.cholesky_solve(second_matrix);
+                    break;
+                }
+                case Operation::LeastSquares: {
+                    result_matrix = first_matrix.least_squares(second_matrix);
+                    break;
+                }
+                default:
+                    return false;
+                    break;
+                }
             }
-            case Operation::Subtract: {
-                result_matrix = first_matrix - second_matrix;
-                break;
+            matrices::serialize::to_csv(result_path, result_matrix, ',');
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    void report_profile(const std::filesystem::path& trace_path) {
+        if (!matrices::profiler::compiled_in) {
+            std::cout << "Profiling is not compiled in, configure with -DMATRICES_PROFILING=ON" << std::endl;
+            return;
+        }
+
+        auto& profile = matrices::profiler::session::instance();
+        profile.stop();
+        profile.summary(std::cout);
+
+        if (!trace_path.empty()) {
+            try {
+                profile.write_chrome_trace(trace_path);
+                std::cout << std::format("Trace exported to {}\n", trace_path.string());
             }
-            case Operation::Multiply: {
-                result_matrix = first_matrix * second_matrix;
-                break;
+            catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
             }
-            default:
-                return false;
+        }
+    }
+
+    // "512M", "2G", "64KiB" or a plain byte count, zero when the text is not a size.
+    std::size_t parse_bytes(const std::string& text) {
+        std::size_t parsed{ 0 };
+        double value{ 0.0 };
+        try {
+            value = std::stod(text, &parsed);
+        }
+        catch (std::exception&) {
+            return 0;
+        }
+
+        auto suffix = text.substr(parsed);
+        std::transform(std::begin(suffix), std::end(suffix), std::begin(suffix), [](unsigned char c) { return std::tolower(c); });
+
+        std::map<std::string, double> multipliers{
+            {"", 1.0}, {"b", 1.0},
+            {"k", 0x1p10}, {"kb", 0x1p10}, {"kib", 0x1p10},
+            {"m", 0x1p20}, {"mb", 0x1p20}, {"mib", 0x1p20},
+            {"g", 0x1p30}, {"gb", 0x1p30}, {"gib", 0x1p30},
+            {"t", 0x1p40}, {"tb", 0x1p40}, {"tib", 0x1p40} };
+
+        if (!multipliers.contains(suffix) || !(value > 0.0)) {
+            return 0;
+        }
+        return static_cast<std::size_t>(value * multipliers[suffix]);
+    }
+
+    // Nominal peak of an operation in its low memory variant: the operands, the result and the scratch memory
+    // of the kernels, without the allocator rounding and the thread arenas.
+    std::size_t estimate_peak_bytes(const Operation& operation, const std::vector<std::pair<std::uint32_t, std::uint32_t>>& operands,
+        const multiply_options& options, const matrices::spectral::options& settings) {
+        auto elements = [](std::size_t rows, std::size_t columns) { return rows * columns; };
+
+        std::size_t inputs{ 0 };
+        for (const auto& [rows, columns] : operands) {
+            inputs += elements(rows, columns);
+        }
+
+        const std::size_t rows = operands.front().first;
+        const std::size_t columns = operands.front().second;
+        const std::size_t first = elements(rows, columns);
+        const std::size_t second = operands.size() > 1 ? elements(operands[1].first, operands[1].second) : 0;
+        const std::size_t second_columns = operands.size() > 1 ? operands[1].second : 0;
+
+        std::size_t extra{ 0 };
+        switch (operation)
+        {
+        case Operation::Add:
+        case Operation::Subtract:
+        case Operation::Hadamard:
+        case Operation::Submatrix:
+        case Operation::At: {
+            extra = first;
+            break;
+        }
+        case Operation::Multiply: {
+            if (operands.size() < 2) {
+                extra = first;
                 break;
             }
-            matrices::serialize::to_csv(result_path, result_matrix, ',');
+
+            extra = elements(rows, second_columns);
+            if (options.algorithm == Algorithm::Strassen) {
+                // zero padded operands and the recursion workspace
+                extra *= 4;
+            }
+            else if (options.precision != Precision::Double) {
+                // the operands are parsed in their (narrower) storage type, then the accumulator and the double result
+                extra = 2 * extra;
+            }
+            break;
+        }
+        case Operation::Solve:
+        case Operation::CholeskySolve: {
+            extra = first + second;
+            break;
+        }
+        case Operation::Invert:
+        case Operation::Cholesky: {
+            extra = first;
+            break;
+        }
+        case Operation::QR: {
+            extra = 2 * first + columns * columns;
+            break;
+        }
+        case Operation::LeastSquares: {
+            extra = first + second + columns * second_columns;
+            break;
+        }
+        case Operation::Power: {
+            extra = 3 * first;
+            break;
+        }
+        case Operation::Eigen: {
+            // Lanczos basis and the eigenvectors
+            extra = rows * (std::min<std::size_t>(rows, settings.max_iterations + 1) + settings.count);
+            break;
+        }
+        case Operation::SVD: {
+            auto sketch = std::min<std::size_t>(settings.count + settings.oversampling, std::min(rows, columns));
+            extra = (3 * rows + 2 * columns) * sketch;
+            break;
+        }
+        case Operation::Chain: {
+            // the two largest intermediate products are alive at the same time
+            std::size_t largest{ 0 };
+            for (std::size_t left = 0; left < operands.size(); ++left) {
+                for (auto right = left; right < operands.size(); ++right) {
+                    largest = std::max(largest, elements(operands[left].first, operands[right].second));
+                }
+            }
+            extra = 2 * largest;
+            break;
+        }
+        case Operation::Traspose:
+        default:
+            // in place or a scalar result
+            break;
+        }
+
+        return (inputs + extra) * sizeof(double);
+    }
+
+    void report_memory() {
+        const auto& tracker = matrices::memory::usage::instance();
+        std::cout << std::format("Peak memory: {} in matrices and scratch, {} resident", matrices::memory::format_bytes(tracker.peak_bytes()),
+            matrices::memory::format_bytes(matrices::memory::peak_resident_bytes()));
+        if (tracker.low_memory()) {
+            std::cout << std::format(", budget {}", matrices::memory::format_bytes(tracker.budget_bytes()));
+        }
+        std::cout << std::endl;
+    }
+
+    bool autotune(const std::filesystem::path& profile_path, bool quick) {
+        try {
+            auto tuned = matrices::tuning::autotune(std::cout, quick);
+            matrices::tuning::save(profile_path, tuned);
+            std::cout << std::format("Tuning profile exported to {}\n", profile_path.string());
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool generate(const boost::program_options::variables_map& v_maps, const std::filesystem::path& result_path) {
+        auto distribution = v_maps["distribution"].as<std::string>();
+        std::transform(std::begin(distribution), std::end(distribution), std::begin(distribution), [](unsigned char c) { return std::tolower(c); });
+
+        std::map<std::string, matrices::generator::Distribution> available_distributions{
+            {"uniform", matrices::generator::Distribution::Uniform}, {"normal", matrices::generator::Distribution::Normal},
+            {"identity", matrices::generator::Distribution::Identity}, {"banded", matrices::generator::Distribution::Banded},
+            {"spd", matrices::generator::Distribution::SPD}, {"sparse", matrices::generator::Distribution::Sparse} };
+
+        if (!available_distributions.contains(distribution)) {
+            std::cout << "Unknown distribution of the generated matrix" << std::endl;
+            return false;
+        }
+
+        matrices::generator::options settings;
+        settings.distribution = available_distributions[distribution];
+        settings.rows = v_maps["row"].as<std::uint32_t>();
+        settings.columns = v_maps["column"].as<std::uint32_t>();
+        settings.seed = v_maps["seed"].as<std::uint64_t>();
+        settings.bandwidth = v_maps["bandwidth"].as<std::uint32_t>();
+        settings.density = v_maps["density"].as<double>();
+
+        try {
+            matrices::generator::to_csv(result_path, settings);
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool apply_to_vectors(const std::filesystem::path& result_path, const std::filesystem::path& matrix_path, const std::string& vectors_path,
+        const matrices::streaming::options& settings) {
+        try {
+            auto matrix = matrices::serialize::from_csv_mapped(matrix_path);
+
+            std::ofstream output(result_path);
+            if (!output.is_open()) {
+                throw std::runtime_error("Unable to open file for writting");
+            }
+
+            matrices::streaming::statistics processed;
+            if (vectors_path == "-") {
+                processed = matrices::streaming::apply(matrix, std::cin, output, settings);
+            }
+            else {
+                std::ifstream input(vectors_path);
+                if (!input.is_open()) {
+                    throw std::runtime_error("Unable to open file for reading");
+                }
+                processed = matrices::streaming::apply(matrix, input, output, settings);
+            }
+
+            output.close();
+            std::cout << std::format("Applied to {} vector(s) in {} batch(es)\n", processed.vectors, processed.batches);
+            std::cout << std::format("Exported to {}\n", result_path.string());
+        }
+        catch (std::exception& e) {
+            std::cout << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool sharded_operation(const std::filesystem::path& result_path, const std::filesystem::path& first_matrix_path, const std::filesystem::path& second_matrix_path,
+        const Operation& operation, const matrices::sharded::options& settings) {
+        try {
+            // the operands go straight into shared memory and the result is written from there, the threads of the
+            // parallel loading are joined before the workers are forked
+            if (operation == Operation::Multiply) {
+                matrices::sharded::multiply(first_matrix_path, second_matrix_path, result_path, settings);
+            }
+            else {
+                matrices::sharded::inverse(first_matrix_path, result_path, settings);
+            }
         }
         catch (std::exception& e) {
             std::cout << e.what() << std::endl;
@@ -142,9 +693,6 @@ namespace matrices::program_options {
     bool process_arguments(const boost::program_options::variables_map& v_maps) {
         std::filesystem::path first_matrix_path, second_matrix_path, result_path;
 
-        first_matrix_path = v_maps["input-matrix"].as<std::string>();
-        result_path = v_maps["result-file"].as<std::string>();
-
         auto operation = v_maps["operation"].as<std::string>();
         std::transform(std::begin(operation), std::end(operation), std::begin(operation), [](unsigned char c) { return std::tolower(c); });
 
@@ -152,13 +700,128 @@ namespace matrices::program_options {
             {"+", Operation::Add} , {"-", Operation::Subtract},
             {"*", Operation::Multiply} , {"invert", Operation::Invert},
             {"transpose", Operation::Traspose},
-            {"submatrix", Operation::Submatrix}, {"at", Operation::At} };
+            {"submatrix", Operation::Submatrix}, {"at", Operation::At},
+            {"solve", Operation::Solve}, {"chain", Operation::Chain},
+            {"power", Operation::Power}, {"cholesky", Operation::Cholesky},
+            {"qr", Operation::QR}, {"cholesky-solve", Operation::CholeskySolve},
+            {"least-squares", Operation::LeastSquares}, {"eigen", Operation::Eigen},
+            {"svd", Operation::SVD}, {"sum", Operation::Sum},
+            {"norm", Operation::Norm}, {"trace", Operation::Trace},
+            {"min", Operation::Min}, {"max", Operation::Max},
+            {"dot", Operation::Dot}, {"hadamard", Operation::Hadamard},
+            {"autotune", Operation::Autotune}, {"generate", Operation::Generate},
+            {"apply", Operation::Apply} };
 
         if (!available_operations.contains(operation)) {
             std::cout << "Matrix with matrix: unknown operation for this type" << std::endl;
             return false;
         }
 
+        if (available_operations[operation] == Operation::Autotune) {
+            auto profile_path = v_maps.contains("tuning-profile") ? std::filesystem::path(v_maps["tuning-profile"].as<std::string>()) : matrices::tuning::default_path();
+            return autotune(profile_path, v_maps.contains("autotune-quick"));
+        }
+
+        if (v_maps.contains("tuning-profile")) {
+            try {
+                matrices::tuning::current() = matrices::tuning::load(v_maps["tuning-profile"].as<std::string>());
+            }
+            catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+        }
+
+        result_path = v_maps["result-file"].as<std::string>();
+        if (available_operations[operation] == Operation::Generate) {
+            return generate(v_maps, result_path);
+        }
+
+        first_matrix_path = v_maps["input-matrix"].as<std::string>();
+
+        auto precision = v_maps["storage-precision"].as<std::string>();
+        std::transform(std::begin(precision), std::end(precision), std::begin(precision), [](unsigned char c) { return std::tolower(c); });
+
+        std::map<std::string, Precision> available_precisions{
+            {"double", Precision::Double}, {"float", Precision::Float},
+            {"bf16", Precision::BFloat16}, {"int16", Precision::Int16},
+            {"int8", Precision::Int8} };
+
+        if (!available_precisions.contains(precision)) {
+            std::cout << "Unknown storage precision" << std::endl;
+            return false;
+        }
+
+        auto algorithm = v_maps["multiply-algorithm"].as<std::string>();
+        std::transform(std::begin(algorithm), std::end(algorithm), std::begin(algorithm), [](unsigned char c) { return std::tolower(c); });
+
+        std::map<std::string, Algorithm> available_algorithms{
+            {"classic", Algorithm::Classic}, {"strassen", Algorithm::Strassen} };
+
+        if (!available_algorithms.contains(algorithm)) {
+            std::cout << "Unknown multiplication algorithm" << std::endl;
+            return false;
+        }
+
+        multiply_options multiply_settings{
+            available_precisions[precision], available_algorithms[algorithm],
+            v_maps.contains("strassen-crossover") ? v_maps["strassen-crossover"].as<std::uint32_t>() : static_cast<std::uint32_t>(matrices::tuning::current().strassen_crossover),
+            v_maps.contains("report-accuracy") };
+
+        if (available_operations[operation] == Operation::Multiply && multiply_settings.algorithm == Algorithm::Strassen && multiply_settings.precision != Precision::Double) {
+            std::cout << "Multiply operation: the Strassen algorithm only supports double storage precision" << std::endl;
+            return false;
+        }
+
+        if (v_maps.contains("numa")) {
+            auto placement = v_maps["numa"].as<std::string>();
+            std::transform(std::begin(placement), std::end(placement), std::begin(placement), [](unsigned char c) { return std::tolower(c); });
+
+            std::map<std::string, matrices::numa::Placement> available_placements{
+                {"none", matrices::numa::Placement::None}, {"interleave", matrices::numa::Placement::Interleave},
+                {"partitioned", matrices::numa::Placement::Partitioned} };
+
+            if (!available_placements.contains(placement)) {
+                std::cout << "Unknown NUMA placement" << std::endl;
+                return false;
+            }
+
+            matrices::numa::current().placement = available_placements[placement];
+            const auto& topology = matrices::numa::topology::instance();
+            std::cout << std::format("NUMA: {} node(s){}, placement {}\n", topology.nodes_count(), topology.is_emulated() ? " (emulated)" : "", placement);
+        }
+
+        if (v_maps.contains("backend")) {
+            auto backend_name = v_maps["backend"].as<std::string>();
+            std::transform(std::begin(backend_name), std::end(backend_name), std::begin(backend_name), [](unsigned char c) { return std::tolower(c); });
+
+            std::map<std::string, matrices::backend::Kind> available_backends{
+                {"builtin", matrices::backend::Kind::Builtin}, {"blas", matrices::backend::Kind::Blas} };
+
+            if (!available_backends.contains(backend_name)) {
+                std::cout << "Unknown backend" << std::endl;
+                return false;
+            }
+
+            try {
+                matrices::backend::select(available_backends[backend_name]);
+            }
+            catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+        }
+        matrices::backend::current().threshold = v_maps.contains("backend-threshold") ? v_maps["backend-threshold"].as<std::uint32_t>() : matrices::tuning::current().backend_threshold;
+
+        if (v_maps.contains("memory-budget")) {
+            auto budget = parse_bytes(v_maps["memory-budget"].as<std::string>());
+            if (budget == 0) {
+                std::cout << "Unknown memory budget" << std::endl;
+                return false;
+            }
+            matrices::memory::usage::instance().set_budget(budget);
+        }
+
         if (v_maps.contains("operand-matrix")) {
             second_matrix_path = v_maps["operand-matrix"].as<std::string>();
         }
@@ -169,6 +832,73 @@ namespace matrices::program_options {
         }
 
         auto operation_v = available_operations[operation];
+
+        std::vector<std::filesystem::path> matrix_paths{ first_matrix_path };
+        if (!second_matrix_path.empty()) {
+            matrix_paths.push_back(second_matrix_path);
+        }
+        if (operation_v == Operation::Chain && v_maps.contains("chain-matrix")) {
+            for (const auto& path : v_maps["chain-matrix"].as<std::vector<std::string>>()) {
+                matrix_paths.push_back(path);
+            }
+        }
+
+        matrices::spectral::options settings;
+        settings.count = v_maps["count"].as<std::uint32_t>();
+        settings.tolerance = v_maps["tolerance"].as<double>();
+        settings.max_iterations = v_maps["max-iterations"].as<std::uint32_t>();
+
+        // fail before anything is allocated when the operation can not fit in the budget
+        if (const auto& tracker = matrices::memory::usage::instance(); tracker.low_memory()) {
+            try {
+                std::vector<std::pair<std::uint32_t, std::uint32_t>> operands;
+                for (const auto& path : matrix_paths) {
+                    operands.push_back(matrices::serialize::csv_dimensions(path));
+                }
+
+                auto estimate = estimate_peak_bytes(operation_v, operands, multiply_settings, settings);
+                if (estimate > tracker.budget_bytes()) {
+                    std::cout << std::format("Memory budget: {} needs an estimated {}, the budget is {}\n", operation,
+                        matrices::memory::format_bytes(estimate), matrices::memory::format_bytes(tracker.budget_bytes()));
+                    return false;
+                }
+            }
+            catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+        }
+
+        if (operation_v == Operation::Chain) {
+            return chain_product(result_path, matrix_paths);
+        }
+
+        if (v_maps.contains("workers") && (operation_v == Operation::Invert || (operation_v == Operation::Multiply && !second_matrix_path.empty()))) {
+            matrices::sharded::options shard_settings;
+            shard_settings.workers = v_maps["workers"].as<std::uint32_t>();
+            shard_settings.shard_size = v_maps["shard-size"].as<std::uint32_t>();
+            return sharded_operation(result_path, first_matrix_path, second_matrix_path, operation_v, shard_settings);
+        }
+
+        if (operation_v == Operation::Apply) {
+            matrices::streaming::options stream_settings;
+            stream_settings.batch_size = v_maps["batch-size"].as<std::uint32_t>();
+            stream_settings.max_latency = std::chrono::milliseconds(v_maps["batch-latency"].as<std::uint32_t>());
+            return apply_to_vectors(result_path, first_matrix_path, v_maps["vectors"].as<std::string>(), stream_settings);
+        }
+
+        switch (operation_v) {
+        case Operation::Sum:
+        case Operation::Norm:
+        case Operation::Trace:
+        case Operation::Min:
+        case Operation::Max:
+        case Operation::Dot:
+            return reduce(first_matrix_path, second_matrix_path, operation_v);
+        default:
+            break;
+        }
+
         if (second_matrix_path.empty()) {
             switch (operation_v) {
             case Operation::Submatrix: {
@@ -177,18 +907,32 @@ namespace matrices::program_options {
                 return submatrix(result_path, first_matrix_path, counts, starts);
             }
             case Operation::Invert:
-            case Operation::Traspose: {
+            case Operation::Traspose:
+            case Operation::Cholesky:
+            case Operation::QR: {
                 return single_matrix(result_path, first_matrix_path, operation_v);
             }
+            case Operation::Power: {
+                return matrix_power(result_path, first_matrix_path, scalar_value);
+            }
+            case Operation::Eigen:
+            case Operation::SVD: {
+                return spectral_estimate(result_path, first_matrix_path, operation_v, settings);
+            }
             default:
             case Operation::At: {
+                if (operation_v == Operation::At && !v_maps["scalar-value"].defaulted()) {
+                    // -S is a row major linear index
+                    return matrix_with_scalar(result_path, first_matrix_path, operation_v, scalar_value);
+                }
+
                 auto [row_index, column_index] = std::make_pair(v_maps["row"].as<std::uint32_t>(), v_maps["column"].as<std::uint32_t>());
                 return submatrix(result_path, first_matrix_path, { 1, 1 }, { row_index , column_index });
             }
             }
         }
         else {
-            return matrix_with_matrix(result_path, first_matrix_path, second_matrix_path, operation_v);
+            return matrix_with_matrix(result_path, first_matrix_path, second_matrix_path, operation_v, multiply_settings);
         }
 
         return false;
@@ -206,6 +950,10 @@ namespace matrices::program_options {
         std::cout << "\t\t Multiplication (operation command: *)\n";
         std::cout << "\t\t Addition (operation command: /)\n";
         std::cout << "\t\t Subtraction (operation command: -)\n";
+        std::cout << "\t\t Solving a linear system (operation command: solve)\n";
+        std::cout << "\t\t Elementwise product, the operand may be a row or a column vector (operation command: hadamard)\n";
+        std::cout << "\t\t Solving a symmetric positive definite system (operation command: cholesky-solve)\n";
+        std::cout << "\t\t Least squares solution of an overdetermined system (operation command: least-squares)\n";
         std::cout << "\tMatrix with Scalar:\n";
         std::cout << "\t\t Multiplication (operation command: *)\n";
         std::cout << "\t\t Addition (operation command: /)\n";
@@ -213,7 +961,31 @@ namespace matrices::program_options {
         std::cout << "\tSingle matrix: \n";
         std::cout << "\t\tTranspose\t(operation command: transpose)\n";
         std::cout << "\t\tInvert\t(operation command: invert)\n";
-        std::cout << "\t\tTaking an element by index.\t(operation command: at)\n";
+        std::cout << "\t\tTaking an element by --row and --column, or by the row major index -S.\t(operation command: at)\n";
+        std::cout << "\t\tInteger power, the exponent is the scalar value\t(operation command: power)\n";
+        std::cout << "\t\tCholesky factor L of a symmetric positive definite matrix\t(operation command: cholesky)\n";
+        std::cout << "\t\tThin QR decomposition, R to the result file and Q to <result>_q\t(operation command: qr)\n";
+        std::cout << "\t\tDominant eigenpairs of a symmetric matrix (Lanczos), vectors to the result file\t(operation command: eigen)\n";
+        std::cout << "\t\tDominant singular triplets (randomized SVD), U to the result file and V to <result>_v\t(operation command: svd)\n";
+        std::cout << "\tReductions, the scalar is printed:\n";
+        std::cout << "\t\tSum, Frobenius norm, trace, minimum, maximum\t(operation commands: sum, norm, trace, min, max)\n";
+        std::cout << "\t\tFrobenius inner product with the operand matrix\t(operation command: dot)\n";
+        std::cout << "\tMachine tuning:\n";
+        std::cout << "\t\tMicro-benchmark block sizes, thread counts and crossovers and save a tuning profile\t(operation command: autotune)\n";
+        std::cout << "\tGeneration:\n";
+        std::cout << "\t\tSynthetic --row x --column matrix of the --distribution to the result file, streamed\t(operation command: generate)\n";
+        std::cout << "\tVector stream:\n";
+        std::cout << "\t\tInput matrix times every --vectors line, one result line per vector\t(operation command: apply)\n";
+        std::cout << "\tMatrix chain:\n";
+        std::cout << "\t\tProduct of the input, operand and every --chain-matrix file in the cheapest order\t(operation command: chain)\n";
+        std::cout << "\nStorage precision for multiplication (--storage-precision):\n";
+        std::cout << "\t\tdouble\t(default)\n";
+        std::cout << "\t\tfloat\t(double accumulation)\n";
+        std::cout << "\t\tbf16\t(float accumulation)\n";
+        std::cout << "\t\tint16, int8\t(int32 accumulation, values are rounded and saturated)\n";
+        std::cout << "\nMultiplication algorithm (--multiply-algorithm):\n";
+        std::cout << "\t\tclassic\t(default)\n";
+        std::cout << "\t\tstrassen\t(square double matrices, see --strassen-crossover and --report-accuracy)\n";
     }
 
     bool parse_command_line(int argc, char** argv, boost::program_options::options_description& options, boost::program_options::variables_map& v_maps) {
@@ -221,20 +993,60 @@ namespace matrices::program_options {
         std::string task_type;
         options.add_options()
             ("help", "produce help message")
-            ("input-matrix,I", boost::program_options::value<std::string>()->required(), "Input file name for the first matrix")
+            ("input-matrix,I", boost::program_options::value<std::string>(), "Input file name for the first matrix (required by every operation but autotune and generate)")
             ("operand-matrix,M", boost::program_options::value<std::string>(), "Input file name for the second matrix")
             ("operation,O", boost::program_options::value < std::string>()->required(), "operation which we should call")
             ("scalar-value,S", boost::program_options::value<double>()->default_value({ 1.0 }), "scalar for the operaiton")
+            ("chain-matrix,C", boost::program_options::value<std::vector<std::string>>()->multitoken(), "further operands of the chain product, in order")
+            ("numa", boost::program_options::value<std::string>(), "NUMA placement of large matrices: none, interleave or partitioned (MATRICES_NUMA_NODES=N emulates N nodes)")
+            ("backend", boost::program_options::value<std::string>(), "dense kernels backend: builtin or blas (if compiled in)")
+            ("backend-threshold", boost::program_options::value<std::uint32_t>(), "smallest dimension routed to the external backend (tuning profile, 128 by default)")
+            ("multiply-algorithm", boost::program_options::value<std::string>()->default_value({ "classic" }), "matrix multiplication algorithm: classic or strassen")
+            ("strassen-crossover", boost::program_options::value<std::uint32_t>(), "size below which Strassen recursion switches to the classic kernel (tuning profile, 256 by default)")
+            ("tuning-profile", boost::program_options::value<std::string>(), "tuning profile to load, or to write with autotune (MATRICES_TUNING_PROFILE, otherwise ~/.matrices_tuning)")
+            ("autotune-quick", "autotune on smaller problems")
+            ("report-accuracy", "compare the Strassen product with the classic one")
+            ("memory-budget", boost::program_options::value<std::string>(), "memory limit for matrices and scratch, e.g. 512M or 2G: low memory variants are used and runs that can not fit fail early")
+            ("profile", boost::program_options::value<std::string>()->implicit_value({ "" }, ""), "print phase timings and kernel counters, with a file name also write a Chrome trace of the run")
+            ("storage-precision,P", boost::program_options::value<std::string>()->default_value({ "double" }), "element storage precision for multiplication: double, float, bf16, int16, int8")
             ("result-file,R", boost::program_options::value<std::string>()->default_value({ "result.csv" }), "output file path for result");
 
         boost::program_options::options_description take_submatrix("\"Submatrix take\" and \"Taking an element by index\" arguments");
         take_submatrix.add_options()
-            ("row", boost::program_options::value<std::uint32_t>()->default_value({ 1 }), "count of rows (submatrix) or index")
-            ("column", boost::program_options::value<std::uint32_t>()->default_value({ 1 }), "count of columns (submatrix) or index")
+            ("row", boost::program_options::value<std::uint32_t>()->default_value({ 1 }), "count of rows (submatrix, generate) or index")
+            ("column", boost::program_options::value<std::uint32_t>()->default_value({ 1 }), "count of columns (submatrix, generate) or index")
             ("start-row", boost::program_options::value<std::uint32_t>()->default_value({ 0 }), "start row position")
             ("start-column", boost::program_options::value<std::uint32_t>()->default_value({ 0 }), "start column position");
 
+        boost::program_options::options_description spectral_estimates("\"eigen\" and \"svd\" arguments");
+        spectral_estimates.add_options()
+            ("count", boost::program_options::value<std::uint32_t>()->default_value({ 3 }), "number of eigenvalues or singular values")
+            ("tolerance", boost::program_options::value<double>()->default_value({ 1e-10 }), "relative convergence tolerance")
+            ("max-iterations", boost::program_options::value<std::uint32_t>()->default_value({ 300 }), "Lanczos steps or SVD power iterations cap");
+
+        boost::program_options::options_description generation("\"generate\" arguments");
+        generation.add_options()
+            ("distribution", boost::program_options::value<std::string>()->default_value({ "uniform" }), "uniform, normal, identity, banded, spd or sparse")
+            ("seed", boost::program_options::value<std::uint64_t>()->default_value({ 42 }), "random seed, the output does not depend on the thread count")
+            ("bandwidth", boost::program_options::value<std::uint32_t>()->default_value({ 1 }), "nonzero diagonals on each side of the main one (banded)")
+            ("density", boost::program_options::value<double>()->default_value({ 0.1 }), "share of nonzero elements (sparse)");
+
+        boost::program_options::options_description vector_stream("\"apply\" arguments");
+        vector_stream.add_options()
+            ("vectors", boost::program_options::value<std::string>()->default_value({ "-" }), "CSV file of the vectors, one per line, - for the standard input")
+            ("batch-size", boost::program_options::value<std::uint32_t>()->default_value({ 256 }), "vectors multiplied together")
+            ("batch-latency", boost::program_options::value<std::uint32_t>()->default_value({ 100 }), "milliseconds a vector may wait for its batch to fill up");
+
+        boost::program_options::options_description sharding("Multi-process \"*\" and \"invert\" arguments");
+        sharding.add_options()
+            ("workers", boost::program_options::value<std::uint32_t>(), "worker processes sharing the operands over POSIX shared memory (matrix product and inverse)")
+            ("shard-size", boost::program_options::value<std::uint32_t>()->default_value({ 0 }), "rows (product) or columns (inverse) of one shard, 0 for four shards per worker");
+
         options.add(take_submatrix);
+        options.add(spectral_estimates);
+        options.add(generation);
+        options.add(vector_stream);
+        options.add(sharding);
         try {
             boost::program_options::command_line_parser parser{ argc, argv };
             parser.options(options);
@@ -244,7 +1056,17 @@ namespace matrices::program_options {
             boost::program_options::notify(v_maps);
 
             boost::program_options::store(boost::program_options::parse_command_line(argc, argv, options), v_maps);
-            return process_arguments(v_maps);
+            auto profiling = v_maps.contains("profile");
+            if (profiling) {
+                matrices::profiler::session::instance().start();
+            }
+
+            auto processed = process_arguments(v_maps);
+            if (profiling) {
+                report_profile(v_maps["profile"].as<std::string>());
+            }
+            report_memory();
+            return processed;
 
         }
         catch (std::exception& ex) {
@@ -0,0 +1,302 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "utility.h"
+#include "parallel.h"
+#include "memory.h"
+#include "tuning.h"
+
+// Reductions over strided element sequences, shared by matrix_d, matrix_f and views of rows or columns.
+// Sums run in `lanes` independent accumulators (mapped onto SIMD registers by the compiler), blocks are
+// combined by pairwise summation and large inputs are split between threads whose partial results are
+// combined as a balanced tree, so the rounding error grows with log(n) rather than n.
+namespace matrices::reduction {
+    inline constexpr std::size_t lanes = 8;
+    inline constexpr std::size_t pairwise_block = 128;
+    [[nodiscard]] inline std::size_t parallel_threshold() {
+        return tuning::current().reduction_parallel_threshold;
+    }
+
+    struct identity {
+        template<typename T>
+        [[nodiscard]] double operator()(const T& value) const {
+            return static_cast<double>(value);
+        }
+    };
+
+    struct square {
+        template<typename T>
+        [[nodiscard]] double operator()(const T& value) const {
+            auto converted = static_cast<double>(value);
+            return converted * converted;
+        }
+    };
+
+    template<typename T, typename Transform>
+    [[nodiscard]] double pairwise_sum(const T* values, std::size_t count, std::size_t stride, const Transform& transform) {
+        if (count <= pairwise_block) {
+            std::array<double, lanes> partial{};
+            std::size_t index{ 0 };
+            for (; index + lanes <= count; index += lanes) {
+                for (std::size_t lane = 0; lane < lanes; ++lane) {
+                    partial[lane] += transform(values[(index + lane) * stride]);
+                }
+            }
+            for (; index < count; ++index) {
+                partial[0] += transform(values[index * stride]);
+            }
+
+            for (auto width = lanes / 2; width > 0; width /= 2) {
+                for (std::size_t lane = 0; lane < width; ++lane) {
+                    partial[lane] += partial[lane + width];
+                }
+            }
+            return partial[0];
+        }
+
+        auto half = (count / 2 + pairwise_block - 1) / pairwise_block * pairwise_block;
+        return pairwise_sum(values, half, stride, transform) + pairwise_sum(values + half * stride, count - half, stride, transform);
+    }
+
+    // Splits [0, count) into one piece per worker and reduces the pieces concurrently, the partial results are
+    // combined pairwise by `combine`.
+    template<typename Result, typename Piece, typename Combine>
+    [[nodiscard]] Result tree_reduce(std::size_t count, const Piece& piece, const Combine& combine) {
+        auto pieces = count < parallel_threshold() ? 1 : std::min(utility::hardware_threads(), count / std::max<std::size_t>(parallel_threshold() / 4, 1));
+        if (pieces <= 1) {
+            return piece(0, count);
+        }
+
+        std::vector<Result> partial(pieces);
+        utility::parallel_for(0, pieces, 1, [&](std::size_t first, std::size_t last) {
+            for (auto index = first; index < last; ++index) {
+                partial[index] = piece(count * index / pieces, count * (index + 1) / pieces);
+            }
+        });
+
+        for (std::size_t width = 1; width < pieces; width *= 2) {
+            for (std::size_t index = 0; index + width < pieces; index += 2 * width) {
+                partial[index] = combine(partial[index], partial[index + width]);
+            }
+        }
+        return partial[0];
+    }
+
+    // sum of transform(values[i * stride]) for i in [0, count)
+    template<typename T, typename Transform = identity>
+    [[nodiscard]] double sum(const T* values, std::size_t count, std::size_t stride = 1, const Transform& transform = {}) {
+        return tree_reduce<double>(count, [&](std::size_t first, std::size_t last) {
+            return pairwise_sum(values + first * stride, last - first, stride, transform);
+        }, [](double left, double right) { return left + right; });
+    }
+
+    template<typename T>
+    [[nodiscard]] double norm(const T* values, std::size_t count, std::size_t stride = 1) {
+        return std::sqrt(sum(values, count, stride, square{}));
+    }
+
+    template<typename T, typename Select>
+    [[nodiscard]] T extremum(const T* values, std::size_t count, std::size_t stride, const Select& select) {
+        if (count == 0) {
+            throw std::runtime_error("Reduction operation: the matrix is empty");
+        }
+
+        return tree_reduce<T>(count, [&](std::size_t first, std::size_t last) {
+            std::array<T, lanes> partial;
+            partial.fill(values[first * stride]);
+
+            auto index = first;
+            for (; index + lanes <= last; index += lanes) {
+                for (std::size_t lane = 0; lane < lanes; ++lane) {
+                    partial[lane] = select(partial[lane], values[(index + lane) * stride]);
+                }
+            }
+            for (; index < last; ++index) {
+                partial[0] = select(partial[0], values[index * stride]);
+            }
+
+            auto result = partial[0];
+            for (std::size_t lane = 1; lane < lanes; ++lane) {
+                result = select(result, partial[lane]);
+            }
+            return result;
+        }, select);
+    }
+
+    template<typename T>
+    [[nodiscard]] T min(const T* values, std::size_t count, std::size_t stride = 1) {
+        return extremum(values, count, stride, [](const T& left, const T& right) { return right < left ? right : left; });
+    }
+
+    template<typename T>
+    [[nodiscard]] T max(const T* values, std::size_t count, std::size_t stride = 1) {
+        return extremum(values, count, stride, [](const T& left, const T& right) { return left < right ? right : left; });
+    }
+
+    template<typename T, typename U>
+    [[nodiscard]] double pairwise_dot(const T* left, std::size_t left_stride, const U* right, std::size_t right_stride, std::size_t count) {
+        if (count <= pairwise_block) {
+            std::array<double, lanes> partial{};
+            std::size_t index{ 0 };
+            for (; index + lanes <= count; index += lanes) {
+                for (std::size_t lane = 0; lane < lanes; ++lane) {
+                    partial[lane] += static_cast<double>(left[(index + lane) * left_stride]) * static_cast<double>(right[(index + lane) * right_stride]);
+                }
+            }
+            for (; index < count; ++index) {
+                partial[0] += static_cast<double>(left[index * left_stride]) * static_cast<double>(right[index * right_stride]);
+            }
+
+            double result{ 0.0 };
+            for (auto value : partial) {
+                result += value;
+            }
+            return result;
+        }
+
+        auto half = (count / 2 + pairwise_block - 1) / pairwise_block * pairwise_block;
+        return pairwise_dot(left, left_stride, right, right_stride, half) +
+            pairwise_dot(left + half * left_stride, left_stride, right + half * right_stride, right_stride, count - half);
+    }
+
+    template<typename T, typename U>
+    [[nodiscard]] double dot(const T* left, const U* right, std::size_t count, std::size_t left_stride = 1, std::size_t right_stride = 1) {
+        return tree_reduce<double>(count, [&](std::size_t first, std::size_t last) {
+            return pairwise_dot(left + first * left_stride, left_stride, right + first * right_stride, right_stride, last - first);
+        }, [](double left_value, double right_value) { return left_value + right_value; });
+    }
+
+    // Reduces every row of a row-major rows x columns block with leading dimension `stride`.
+    template<typename T>
+    [[nodiscard]] std::vector<double> rows(const T* values, std::size_t rows_count, std::size_t columns_count, std::size_t stride, utility::Reduction kind) {
+        std::vector<double> result(rows_count);
+        auto grain = std::max<std::size_t>(1, parallel_threshold() / std::max<std::size_t>(columns_count, 1));
+
+        auto reduce_rows = [&](std::size_t first, std::size_t last) {
+            for (auto ri = first; ri < last; ++ri) {
+                const auto* row = values + ri * stride;
+                switch (kind) {
+                case utility::Reduction::Sum:
+                    result[ri] = pairwise_sum(row, columns_count, 1, identity{});
+                    break;
+                case utility::Reduction::Norm:
+                    result[ri] = std::sqrt(pairwise_sum(row, columns_count, 1, square{}));
+                    break;
+                case utility::Reduction::Min:
+                    result[ri] = columns_count == 0 ? 0.0 : static_cast<double>(*std::min_element(row, row + columns_count));
+                    break;
+                case utility::Reduction::Max:
+                    result[ri] = columns_count == 0 ? 0.0 : static_cast<double>(*std::max_element(row, row + columns_count));
+                    break;
+                }
+            }
+        };
+
+        if (rows_count * columns_count < parallel_threshold()) {
+            reduce_rows(0, rows_count);
+        }
+        else {
+            utility::parallel_for(0, rows_count, grain, reduce_rows);
+        }
+        return result;
+    }
+
+    // Column partials of rows [0, rows_count) for columns [first, last) into out, pairwise over the rows so the
+    // inner loop runs along contiguous row segments.
+    template<typename T>
+    void column_pairwise(const T* values, std::size_t rows_count, std::size_t stride, std::size_t first, std::size_t last,
+        utility::Reduction kind, double* out) {
+        const auto width = last - first;
+
+        if (rows_count <= pairwise_block) {
+            for (std::size_t ri = 0; ri < rows_count; ++ri) {
+                const auto* row = values + ri * stride + first;
+                for (std::size_t ci = 0; ci < width; ++ci) {
+                    auto value = static_cast<double>(row[ci]);
+                    switch (kind) {
+                    case utility::Reduction::Sum:
+                        out[ci] = ri == 0 ? value : out[ci] + value;
+                        break;
+                    case utility::Reduction::Norm:
+                        out[ci] = ri == 0 ? value * value : out[ci] + value * value;
+                        break;
+                    case utility::Reduction::Min:
+                        out[ci] = ri == 0 ? value : std::min(out[ci], value);
+                        break;
+                    case utility::Reduction::Max:
+                        out[ci] = ri == 0 ? value : std::max(out[ci], value);
+                        break;
+                    }
+                }
+            }
+            return;
+        }
+
+        auto half = (rows_count / 2 + pairwise_block - 1) / pairwise_block * pairwise_block;
+        memory::arena_scope scratch;
+        auto* second = scratch.allocate<double>(width);
+
+        column_pairwise(values, half, stride, first, last, kind, out);
+        column_pairwise(values + half * stride, rows_count - half, stride, first, last, kind, second);
+
+        for (std::size_t ci = 0; ci < width; ++ci) {
+            switch (kind) {
+            case utility::Reduction::Sum:
+            case utility::Reduction::Norm:
+                out[ci] += second[ci];
+                break;
+            case utility::Reduction::Min:
+                out[ci] = std::min(out[ci], second[ci]);
+                break;
+            case utility::Reduction::Max:
+                out[ci] = std::max(out[ci], second[ci]);
+                break;
+            }
+        }
+    }
+
+    // Reduces every column of a row-major rows x columns block with leading dimension `stride`.
+    template<typename T>
+    [[nodiscard]] std::vector<double> columns(const T* values, std::size_t rows_count, std::size_t columns_count, std::size_t stride, utility::Reduction kind) {
+        std::vector<double> result(columns_count, 0.0);
+        if (rows_count == 0) {
+            return result;
+        }
+
+        auto reduce_columns = [&](std::size_t first, std::size_t last) {
+            column_pairwise(values, rows_count, stride, first, last, kind, result.data() + first);
+        };
+
+        if (rows_count * columns_count < parallel_threshold()) {
+            reduce_columns(0, columns_count);
+        }
+        else {
+            utility::parallel_for(0, columns_count, 64, reduce_columns);
+        }
+
+        if (kind == utility::Reduction::Norm) {
+            for (auto& value : result) {
+                value = std::sqrt(value);
+            }
+        }
+        return result;
+    }
+}
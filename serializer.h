@@ -12,13 +12,22 @@
 
 #pragma once
 
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <filesystem>
 #include <sstream>
 #include <format>
+#include <algorithm>
+#include <utility>
 
 #include "matrices.h"
+#include "mapping.h"
+#include "parallel.h"
 
 namespace matrices::serialize {
     template<typename Matrix>
@@ -26,31 +35,39 @@ namespace matrices::serialize {
         value.get_columns_count();
         value.get_rows_count();
         value(0, 0);
+        value.row_span(0);
     };
 
+    template<is_matrix Matrix>
+    void write_csv_rows(std::ostream& file, const Matrix& matrix, std::uint32_t first_row, std::uint32_t last_row, const char delim = ',') {
+        for (std::uint32_t ri = first_row; ri < last_row; ++ri) {
+            const auto row = matrix.row_span(ri);
+            for (std::size_t ci = 0; ci < row.size(); ++ci) {
+                file << row[ci];
+
+                if (ci < row.size() - 1)
+                    file << delim;
+            }
+            file << "\n";
+        }
+    }
+
     template<is_matrix Matrix>
     void to_csv(const std::filesystem::path& input_file, const Matrix& matrix, const char delim = ',') {
+        MATRICES_PROFILE_SCOPE("write", "phase");
         std::ofstream file(input_file);
 
         if (!file.is_open()) {
             throw std::runtime_error("Unable to open file for writting");
         }
 
-        for (std::uint32_t ri = 0; ri < matrix.get_rows_count(); ++ri) {
-            for (std::uint32_t ci = 0; ci < matrix.get_columns_count(); ++ci) {
-                file << matrix(ri, ci);
-
-                if (ci < matrix.get_columns_count() - 1)
-                    file << delim;
-            }
-            file << "\n";
-        }
+        write_csv_rows(file, matrix, 0, matrix.get_rows_count(), delim);
 
         file.close();
         std::cout << std::format("Exported to {}\n", input_file.string());
     }
 
-    auto from_csv(const std::filesystem::path& input_file) {
+    inline std::ifstream open_csv(const std::filesystem::path& input_file) {
         if (!std::filesystem::exists(input_file) || !std::filesystem::is_regular_file(input_file)) {
             throw std::runtime_error("Unable to open file for reading");
         }
@@ -59,23 +76,98 @@ namespace matrices::serialize {
         if (!in.good() || !in.is_open()) {
             throw std::runtime_error("Unable to open file for reading");
         }
+        return in;
+    }
+
+    // number of values from_csv reads from the line
+    [[nodiscard]] inline std::uint32_t csv_columns(std::string_view line) {
+        if (line.empty()) {
+            return 0;
+        }
+        return static_cast<std::uint32_t>(std::count(std::begin(line), std::end(line), ',')) + (line.back() == ',' ? 0 : 1);
+    }
+
+    // Rows and columns of the matrix stored in a CSV file, without keeping its values.
+    [[nodiscard]] inline std::pair<std::uint32_t, std::uint32_t> csv_dimensions(const std::filesystem::path& input_file) {
+        auto in = open_csv(input_file);
+
+        std::uint32_t num_rows{ 0 }, num_columns{ 0 };
+        for (std::string line; std::getline(in, line); ++num_rows) {
+            num_columns = std::max(num_columns, csv_columns(line));
+        }
+        return { num_rows, num_columns };
+    }
+
+    // Calls store(column, value) for every value of one CSV line and returns their number. A trailing delimiter
+    // does not start a value, empty values are zero and anything else that is not a number throws. Every CSV
+    // loader parses its lines with it, so they all accept the same files.
+    template<typename Store>
+    std::uint32_t parse_csv_line(std::string_view line, Store&& store, const char delim = ',') {
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        std::uint32_t column{ 0 };
+        while (!line.empty()) {
+            auto end = line.find(delim);
+            auto token = line.substr(0, end);
+
+            auto first = token.find_first_not_of(" \t+");
+            auto last = token.find_last_not_of(" \t");
+            token = first == std::string_view::npos ? std::string_view{} : token.substr(first, last - first + 1);
+
+            double value{ 0.0 };
+            if (!token.empty()) {
+                auto [parsed_end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+                if (error != std::errc{} || parsed_end != token.data() + token.size()) {
+                    throw std::runtime_error(std::format("Unable to parse the value \"{}\"", token));
+                }
+            }
+            store(column++, value);
+
+            if (end == std::string_view::npos) {
+                break;
+            }
+            line.remove_prefix(end + 1);
+        }
+        return column;
+    }
+
+    auto from_csv(const std::filesystem::path& input_file) {
+        MATRICES_PROFILE_SCOPE("load", "phase");
+        auto in = open_csv(input_file);
+
+        if (memory::usage::instance().low_memory()) {
+            // two passes over the file, the values go straight into the matrix without per row buffers
+            auto [num_rows, num_columns] = csv_dimensions(input_file);
+            matrices::matrix_d<double> result(num_rows, num_columns);
+
+            std::string line;
+            for (std::uint32_t row_index{ 0 }; row_index < num_rows && std::getline(in, line); ++row_index) {
+                auto row = result.row_span(row_index);
+                auto columns = parse_csv_line(line, [&](std::uint32_t column, double value) {
+                    row[column] = value;
+                });
+
+                // short rows are zero padded as by add_row, the constructor leaves an identity matrix
+                std::fill(std::begin(row) + columns, std::end(row), 0.0);
+            }
+
+            std::cout << std::format("Loaded from {}\n", input_file.string());
+            return result;
+        }
 
         std::uint32_t num_rows{ 0 }, num_columns{ 0 };
         std::vector<std::vector<double>> data;
 
         std::string line;
         while (std::getline(in, line)) {
-            std::stringstream ss(line);
-
-            double value{ 0 };
             std::vector<double> row_data;
             row_data.reserve(num_columns);
 
-            std::uint32_t columns_counter{ 0 };
-            for (std::string token{}; std::getline(ss, token, ','); ++columns_counter) {
-                std::istringstream(token) >> value;
+            auto columns_counter = parse_csv_line(line, [&](std::uint32_t, double value) {
                 row_data.push_back(value);
-            }
+            });
 
             num_columns = std::max(num_columns, columns_counter);
             data.push_back(std::move(row_data));
@@ -91,4 +183,129 @@ namespace matrices::serialize {
         std::cout << std::format("Loaded from {}\n", input_file.string());
         return result;
     }
+
+    // Lines of CSV text without their line breaks, `columns` is set to the width of the widest one.
+    [[nodiscard]] inline std::vector<std::string_view> csv_lines(std::string_view text, std::uint32_t& columns) {
+        std::vector<std::string_view> lines;
+        columns = 0;
+        for (std::size_t first = 0; first < text.size();) {
+            auto last = std::min(text.find('\n', first), text.size());
+            auto line = text.substr(first, last - first);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+
+            lines.push_back(line);
+            columns = std::max(columns, csv_columns(line));
+            first = last + 1;
+        }
+        return lines;
+    }
+
+    // Parses the lines in parallel into the row major lines.size() x columns destination, converting every value
+    // to the element type. Short rows are zero padded.
+    template<typename T>
+    void parse_csv_rows(const std::vector<std::string_view>& lines, std::uint32_t columns, T* destination) {
+        utility::parallel_for(0, lines.size(), 64, [&](std::size_t first_row, std::size_t last_row) {
+            for (auto ri = first_row; ri < last_row; ++ri) {
+                auto* row = destination + ri * columns;
+                auto parsed = parse_csv_line(lines[ri], [&](std::uint32_t column, double value) {
+                    row[column] = utility::convert<T>(value);
+                });
+                std::fill(row + parsed, row + columns, T{ 0 });
+            }
+        });
+    }
+
+    // from_csv over the memory mapped file: the values are parsed in parallel straight into the matrix, without
+    // a copy of the text or per row buffers. Narrow element types are converted as by matrix_d::cast.
+    template<typename T = double>
+    matrices::matrix_d<T> from_csv_mapped(const std::filesystem::path& input_file) {
+        MATRICES_PROFILE_SCOPE("load", "phase");
+        mapping::mapped_file file(input_file);
+
+        std::uint32_t num_columns{ 0 };
+        auto lines = csv_lines(file.view(), num_columns);
+
+        matrices::matrix_d<T> result(static_cast<std::uint32_t>(lines.size()), num_columns);
+        parse_csv_rows(lines, num_columns, result.begin());
+
+        std::cout << std::format("Loaded from {}\n", input_file.string());
+        return result;
+    }
+
+    // Binary layout of matrix files and shared memory segments: this header, then the rows of doubles in the
+    // native byte order.
+    struct binary_header {
+        char magic[8]{ 'M', 'A', 'T', 'R', 'I', 'C', 'E', 'S' };
+        std::uint32_t version{ 1 };
+        std::uint32_t element_size{ sizeof(double) };
+        std::uint64_t rows{ 0 };
+        std::uint64_t columns{ 0 };
+    };
+    static_assert(sizeof(binary_header) == 32);
+
+    [[nodiscard]] inline std::size_t binary_size(std::uint64_t rows, std::uint64_t columns) {
+        return sizeof(binary_header) + rows * columns * sizeof(double);
+    }
+
+    // Whether `bytes` start like a binary matrix rather than CSV text.
+    [[nodiscard]] inline bool is_binary(std::string_view bytes) {
+        return bytes.size() >= sizeof(binary_header::magic) && std::memcmp(bytes.data(), binary_header{}.magic, sizeof(binary_header::magic)) == 0;
+    }
+
+    // Header of the binary matrix in `bytes`, throws when they do not hold one.
+    [[nodiscard]] inline binary_header read_binary_header(std::string_view bytes) {
+        binary_header header;
+        if (bytes.size() < sizeof(binary_header)) {
+            throw std::runtime_error("Binary matrix: truncated header");
+        }
+        std::memcpy(&header, bytes.data(), sizeof(binary_header));
+
+        if (std::memcmp(header.magic, binary_header{}.magic, sizeof(header.magic)) != 0 || header.version != 1 || header.element_size != sizeof(double)) {
+            throw std::runtime_error("Binary matrix: unknown format");
+        }
+        if (header.rows > std::numeric_limits<std::uint32_t>::max() || header.columns > std::numeric_limits<std::uint32_t>::max() ||
+            bytes.size() < binary_size(header.rows, header.columns)) {
+            throw std::runtime_error("Binary matrix: truncated data");
+        }
+        return header;
+    }
+
+    template<is_matrix Matrix>
+    void to_binary(const std::filesystem::path& output_file, const Matrix& matrix) {
+        MATRICES_PROFILE_SCOPE("write", "phase");
+        std::ofstream file(output_file, std::ios::binary);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file for writting");
+        }
+
+        binary_header header;
+        header.rows = matrix.get_rows_count();
+        header.columns = matrix.get_columns_count();
+        file.write(reinterpret_cast<const char*>(&header), sizeof(binary_header));
+
+        std::vector<double> values(header.columns);
+        for (std::uint32_t ri = 0; ri < matrix.get_rows_count(); ++ri) {
+            const auto row = matrix.row_span(ri);
+            std::transform(std::begin(row), std::end(row), std::begin(values), [](const auto& value) { return static_cast<double>(value); });
+            file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(double)));
+        }
+
+        file.close();
+        std::cout << std::format("Exported to {}\n", output_file.string());
+    }
+
+    inline matrices::matrix_d<double> from_binary(const std::filesystem::path& input_file) {
+        MATRICES_PROFILE_SCOPE("load", "phase");
+        mapping::mapped_file file(input_file);
+        auto header = read_binary_header(file.view());
+
+        matrices::matrix_d<double> result(static_cast<std::uint32_t>(header.rows), static_cast<std::uint32_t>(header.columns));
+        std::memcpy(result.begin(), file.view().data() + sizeof(binary_header), header.rows * header.columns * sizeof(double));
+
+        std::cout << std::format("Loaded from {}\n", input_file.string());
+        return result;
+    }
 }
@@ -0,0 +1,362 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "dynamic_matrix.h"
+#include "factorization.h"
+#include "mapping.h"
+#include "parallel.h"
+#include "serializer.h"
+#include "tuning.h"
+
+// Multi-process execution of one large operation. The coordinator puts the operands and the result in POSIX
+// shared memory segments in the binary layout of serialize::binary_header and splits the result into shards
+// (bands of rows for products, blocks of columns for inverses). Worker processes take shards from the shared
+// control block and write their part of the result straight into the result segment, so every worker only
+// needs its scratch memory and a crashed worker costs its unfinished shards, which the coordinator
+// recomputes. Everything a worker reads is addressed by segment names and offsets, the protocol does not
+// depend on the workers being forked from the coordinator.
+namespace matrices::sharded {
+    struct options {
+        // worker processes
+        std::uint32_t workers{ 2 };
+        // rows (products) or columns (inverses) of one shard, zero for four shards per worker
+        std::uint32_t shard_size{ 0 };
+    };
+
+    enum class ShardState : std::uint32_t {
+        Pending,
+        Taken,
+        Done
+    };
+
+    // Start of the control segment, followed by one state per shard.
+    struct control_block {
+        std::atomic<std::uint64_t> next_shard{ 0 };
+        std::uint64_t shards_count{ 0 };
+        std::uint64_t shard_size{ 0 };
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free && std::atomic<std::uint32_t>::is_always_lock_free,
+        "shared memory atomics must not depend on a per process lock");
+
+    namespace detail {
+        [[nodiscard]] inline std::string segment_name(const char* role) {
+            static std::atomic<std::uint32_t> counter{ 0 };
+#ifdef __linux__
+            auto process = static_cast<long>(::getpid());
+#else
+            long process = 0;
+#endif
+            return std::format("/matrices_{}_{}_{}", process, counter++, role);
+        }
+
+        [[nodiscard]] inline double* values(const mapping::shared_segment& segment) {
+            return reinterpret_cast<double*>(segment.data() + sizeof(serialize::binary_header));
+        }
+
+        // segment in the binary layout with room for a rows x columns matrix and `extra` more bytes
+        [[nodiscard]] inline mapping::shared_segment matrix_segment(const char* role, std::uint32_t rows, std::uint32_t columns, std::size_t extra = 0) {
+            auto segment = mapping::shared_segment::create(segment_name(role), serialize::binary_size(rows, columns) + extra);
+
+            serialize::binary_header header;
+            header.rows = rows;
+            header.columns = columns;
+            std::memcpy(segment.data(), &header, sizeof(serialize::binary_header));
+            return segment;
+        }
+
+        [[nodiscard]] inline serialize::binary_header header(const mapping::shared_segment& segment) {
+            return serialize::read_binary_header({ reinterpret_cast<const char*>(segment.data()), segment.size() });
+        }
+
+        [[nodiscard]] inline mapping::shared_segment share(const char* role, const matrix_d<double>& matrix, std::size_t extra_per_row = 0) {
+            auto segment = matrix_segment(role, matrix.get_rows_count(), matrix.get_columns_count(), matrix.get_rows_count() * extra_per_row);
+            std::copy(matrix.begin(), matrix.end(), values(segment));
+            return segment;
+        }
+
+        [[nodiscard]] inline matrix_d<double> unshare(const mapping::shared_segment& segment) {
+            auto dimensions = header(segment);
+            matrix_d<double> result(static_cast<std::uint32_t>(dimensions.rows), static_cast<std::uint32_t>(dimensions.columns));
+            std::copy(values(segment), values(segment) + dimensions.rows * dimensions.columns, result.begin());
+            return result;
+        }
+
+        // Loads a CSV or binary matrix file straight into a new segment, the matrix is never held in process memory.
+        [[nodiscard]] inline mapping::shared_segment load(const char* role, const std::filesystem::path& path, std::size_t extra_per_row = 0) {
+            MATRICES_PROFILE_SCOPE("load", "phase");
+            mapping::mapped_file file(path);
+            auto text = file.view();
+
+            if (serialize::is_binary(text)) {
+                auto dimensions = serialize::read_binary_header(text);
+                auto segment = matrix_segment(role, static_cast<std::uint32_t>(dimensions.rows), static_cast<std::uint32_t>(dimensions.columns), dimensions.rows * extra_per_row);
+                std::memcpy(values(segment), text.data() + sizeof(serialize::binary_header), dimensions.rows * dimensions.columns * sizeof(double));
+                std::cout << std::format("Loaded from {}\n", path.string());
+                return segment;
+            }
+
+            std::uint32_t columns{ 0 };
+            auto lines = serialize::csv_lines(text, columns);
+            auto segment = matrix_segment(role, static_cast<std::uint32_t>(lines.size()), columns, lines.size() * extra_per_row);
+            serialize::parse_csv_rows(lines, columns, values(segment));
+            std::cout << std::format("Loaded from {}\n", path.string());
+            return segment;
+        }
+
+        // Read only matrix over a segment in the binary layout, lets the serializer write a result in place.
+        class segment_view final {
+            const double* elements{ nullptr };
+            std::uint32_t rows_count{ 0 };
+            std::uint32_t columns_count{ 0 };
+        public:
+            explicit segment_view(const mapping::shared_segment& segment) : elements(values(segment)) {
+                auto dimensions = header(segment);
+                rows_count = static_cast<std::uint32_t>(dimensions.rows);
+                columns_count = static_cast<std::uint32_t>(dimensions.columns);
+            }
+
+            [[nodiscard]] std::uint32_t get_rows_count() const {
+                return rows_count;
+            }
+
+            [[nodiscard]] std::uint32_t get_columns_count() const {
+                return columns_count;
+            }
+
+            [[nodiscard]] double operator()(std::uint32_t row, std::uint32_t col) const {
+                return elements[static_cast<std::size_t>(row) * columns_count + col];
+            }
+
+            [[nodiscard]] std::span<const double> row_span(std::uint32_t row) const {
+                return { elements + static_cast<std::size_t>(row) * columns_count, columns_count };
+            }
+        };
+
+        [[nodiscard]] inline std::atomic<std::uint32_t>* states(const mapping::shared_segment& control) {
+            return reinterpret_cast<std::atomic<std::uint32_t>*>(control.data() + sizeof(control_block));
+        }
+
+        // Worker loop: takes shards until none are left.
+        inline void work(const mapping::shared_segment& control, const std::function<void(std::uint64_t)>& compute) {
+            auto& block = *reinterpret_cast<control_block*>(control.data());
+            auto* shard_states = states(control);
+
+            for (auto shard = block.next_shard++; shard < block.shards_count; shard = block.next_shard++) {
+                shard_states[shard].store(static_cast<std::uint32_t>(ShardState::Taken));
+                compute(shard);
+                shard_states[shard].store(static_cast<std::uint32_t>(ShardState::Done));
+            }
+        }
+
+        // Runs compute(shard) for every shard in the worker processes, then on the calling process for the shards
+        // that a failed worker left unfinished.
+        inline void run(const char* operation, std::uint32_t workers, std::uint64_t shards_count, std::uint64_t shard_size,
+            const std::function<void(std::uint64_t)>& compute) {
+            auto control = mapping::shared_segment::create(segment_name("control"), sizeof(control_block) + shards_count * sizeof(std::atomic<std::uint32_t>));
+            auto& block = *new (control.data()) control_block{};
+            block.shards_count = shards_count;
+            block.shard_size = shard_size;
+            for (std::uint64_t shard = 0; shard < shards_count; ++shard) {
+                new (states(control) + shard) std::atomic<std::uint32_t>(static_cast<std::uint32_t>(ShardState::Pending));
+            }
+
+            std::uint32_t failed{ 0 };
+#ifdef __linux__
+            // buffered output would otherwise be written once more by every worker
+            std::cout.flush();
+            std::fflush(nullptr);
+
+            // the workers split the hardware threads between them instead of each starting one thread per core
+            const auto worker_threads = std::max<std::size_t>(utility::hardware_threads() / std::max<std::uint32_t>(workers, 1), 1);
+
+            std::vector<pid_t> processes;
+            for (std::uint32_t index = 0; index < workers; ++index) {
+                auto process = ::fork();
+                if (process < 0) {
+                    break;
+                }
+                if (process == 0) {
+                    tuning::current().threads = worker_threads;
+                    int status{ 0 };
+                    try {
+                        work(control, compute);
+                    }
+                    catch (...) {
+                        status = 1;
+                    }
+                    ::_exit(status);
+                }
+                processes.push_back(process);
+            }
+
+            for (std::size_t index = 0; index < processes.size(); ++index) {
+                int status{ 0 };
+                while (::waitpid(processes[index], &status, 0) < 0 && errno == EINTR) {
+                }
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    ++failed;
+                    std::cout << std::format("{}: worker {} (process {}) {}\n", operation, index, processes[index],
+                        WIFSIGNALED(status) ? std::format("was killed by signal {}", WTERMSIG(status)) : std::string("failed"));
+                }
+            }
+#endif
+
+            // shards of failed workers, or all of them when no worker could be started
+            std::uint64_t recomputed{ 0 };
+            for (std::uint64_t shard = 0; shard < shards_count; ++shard) {
+                if (states(control)[shard].load() != static_cast<std::uint32_t>(ShardState::Done)) {
+                    compute(shard);
+                    ++recomputed;
+                }
+            }
+            if (failed > 0) {
+                std::cout << std::format("{}: {} shard(s) recomputed by the coordinator\n", operation, recomputed);
+            }
+        }
+
+        [[nodiscard]] inline std::uint64_t shard_size(std::uint64_t total, const options& settings) {
+            if (settings.shard_size != 0) {
+                return settings.shard_size;
+            }
+            auto shards = std::max<std::uint64_t>(std::uint64_t{ settings.workers } * 4, 1);
+            return std::max<std::uint64_t>((total + shards - 1) / shards, 1);
+        }
+
+        // a * b into a new segment, bands of rows of the product are computed by the workers.
+        [[nodiscard]] inline mapping::shared_segment multiply(const mapping::shared_segment& a, const mapping::shared_segment& b, const options& settings) {
+            auto left = header(a);
+            auto right = header(b);
+            if (left.columns != right.rows) {
+                throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
+            }
+
+            const std::size_t m = left.rows;
+            const std::size_t k = left.columns;
+            const std::size_t n = right.columns;
+
+            auto c = matrix_segment("product", static_cast<std::uint32_t>(m), static_cast<std::uint32_t>(n));
+
+            const auto rows = shard_size(m, settings);
+            run("Sharded multiply", settings.workers, (m + rows - 1) / rows, rows, [&](std::uint64_t shard) {
+                auto first = shard * rows;
+                auto last = std::min<std::uint64_t>(first + rows, m);
+                matrix_d<double>::multiply_into(last - first, n, k, values(a) + first * k, k, values(b), n, values(c) + first * n, n);
+            });
+            return c;
+        }
+
+        // Inverse from the LU factors into a new segment: the matrix is factored in place by the coordinator, the
+        // workers solve for blocks of columns of the inverse. `factors` needs room for one pivot per row after the matrix.
+        [[nodiscard]] inline mapping::shared_segment inverse(const mapping::shared_segment& factors, const options& settings) {
+            auto dimensions = header(factors);
+            if (dimensions.rows != dimensions.columns) {
+                throw std::runtime_error("Inverse matrix operation: The matrix must be square");
+            }
+
+            const std::size_t n = dimensions.rows;
+            auto* pivots = reinterpret_cast<std::size_t*>(values(factors) + n * n);
+            try {
+                factorization::lu(values(factors), n, pivots);
+            }
+            catch (const std::runtime_error&) {
+                throw std::runtime_error("Inverse matrix operation: Invertible matrix");
+            }
+
+            auto c = matrix_segment("inverse", static_cast<std::uint32_t>(n), static_cast<std::uint32_t>(n));
+
+            const auto columns = shard_size(n, settings);
+            run("Sharded inverse", settings.workers, (n + columns - 1) / columns, columns, [&](std::uint64_t shard) {
+                auto first = shard * columns;
+                auto width = std::min<std::uint64_t>(first + columns, n) - first;
+
+                memory::arena_scope scratch;
+                auto* block = scratch.allocate<double>(n * width);
+                std::fill(block, block + n * width, 0.0);
+                for (std::size_t ci = 0; ci < width; ++ci) {
+                    block[(first + ci) * width + ci] = 1.0;
+                }
+
+                factorization::lu_solve(values(factors), pivots, n, block, width, width);
+
+                auto* result = values(c);
+                for (std::size_t ri = 0; ri < n; ++ri) {
+                    std::copy(block + ri * width, block + (ri + 1) * width, result + ri * n + first);
+                }
+            });
+            return c;
+        }
+    }
+
+    // left * right, bands of rows of the product are computed by the workers.
+    [[nodiscard]] inline matrix_d<double> multiply(const matrix_d<double>& left, const matrix_d<double>& right, const options& settings = {}) {
+        if (left.get_columns_count() != right.get_rows_count()) {
+            throw std::runtime_error("Multiply operation: The conditions of the operation are not met");
+        }
+
+        auto a = detail::share("left", left);
+        auto b = detail::share("right", right);
+        return detail::unshare(detail::multiply(a, b, settings));
+    }
+
+    // Product of two CSV or binary matrix files written to a CSV file. The operands are loaded straight into the
+    // shared segments and the result is written from its segment, the coordinator holds no second copy.
+    inline void multiply(const std::filesystem::path& left_file, const std::filesystem::path& right_file, const std::filesystem::path& result_file,
+        const options& settings = {}) {
+        auto a = detail::load("left", left_file);
+        auto b = detail::load("right", right_file);
+        auto c = profiler::phase("compute", [&]() { return detail::multiply(a, b, settings); });
+        serialize::to_csv(result_file, detail::segment_view(c), ',');
+    }
+
+    // Inverse from the LU factors: the coordinator factors the matrix, the workers solve for blocks of columns
+    // of the inverse.
+    [[nodiscard]] inline matrix_d<double> inverse(const matrix_d<double>& matrix, const options& settings = {}) {
+        if (matrix.get_rows_count() != matrix.get_columns_count()) {
+            throw std::runtime_error("Inverse matrix operation: The matrix must be square");
+        }
+
+        auto factors = detail::share("lu", matrix, sizeof(std::size_t));
+        return detail::unshare(detail::inverse(factors, settings));
+    }
+
+    // Inverse of a CSV or binary matrix file written to a CSV file, loaded into and written from shared memory
+    // like the file product.
+    inline void inverse(const std::filesystem::path& matrix_file, const std::filesystem::path& result_file, const options& settings = {}) {
+        auto factors = detail::load("lu", matrix_file, sizeof(std::size_t));
+        auto c = profiler::phase("compute", [&]() { return detail::inverse(factors, settings); });
+        serialize::to_csv(result_file, detail::segment_view(c), ',');
+    }
+}
@@ -0,0 +1,454 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "dynamic_matrix.h"
+#include "parallel.h"
+
+// Iterative estimates of a few dominant eigenvalues and singular values. The solvers only need products with
+// the matrix, so any operator (a dense matrix_d, a sparse or implicit matrix) can be passed as a function.
+namespace matrices::spectral {
+    struct options {
+        // number of eigenvalues or singular values to estimate
+        std::size_t count{ 3 };
+        // relative residual (Lanczos) or relative change between iterations (randomized SVD) to stop at
+        double tolerance{ 1e-10 };
+        // Lanczos steps or randomized SVD power iterations
+        std::size_t max_iterations{ 300 };
+        // extra columns of the randomized range finder
+        std::size_t oversampling{ 10 };
+        std::uint64_t seed{ 42 };
+    };
+
+    struct eigen_result {
+        // by decreasing magnitude
+        std::vector<double> values;
+        // n x count, column i belongs to values[i]
+        matrix_d<double> vectors;
+        std::size_t iterations{ 0 };
+        bool converged{ false };
+    };
+
+    struct svd_result {
+        // decreasing
+        std::vector<double> values;
+        // rows x count and columns x count
+        matrix_d<double> left;
+        matrix_d<double> right;
+        std::size_t iterations{ 0 };
+        bool converged{ false };
+    };
+
+    // y = A x for a symmetric operator of order n
+    using symmetric_operator = std::function<void(const std::vector<double>& x, std::vector<double>& y)>;
+
+    // Eigen decomposition of the symmetric tridiagonal matrix (diagonal, off_diagonal[0, size - 1)) by the
+    // implicit QL method. Eigenvalues replace the diagonal, the eigenvectors are the columns of z (size x size).
+    inline void tridiagonal_eigen(std::vector<double>& diagonal, std::vector<double> off_diagonal, std::vector<double>& z) {
+        const auto size = static_cast<std::ptrdiff_t>(diagonal.size());
+        off_diagonal.resize(diagonal.size(), 0.0);
+        off_diagonal.back() = 0.0;
+
+        z.assign(diagonal.size() * diagonal.size(), 0.0);
+        for (std::ptrdiff_t i = 0; i < size; ++i) {
+            z[i * size + i] = 1.0;
+        }
+
+        auto& d = diagonal;
+        auto& e = off_diagonal;
+        for (std::ptrdiff_t l = 0; l < size; ++l) {
+            std::size_t iterations{ 0 };
+            std::ptrdiff_t m{ 0 };
+
+            do {
+                for (m = l; m < size - 1; ++m) {
+                    auto scale = std::abs(d[m]) + std::abs(d[m + 1]);
+                    if (std::abs(e[m]) <= std::numeric_limits<double>::epsilon() * scale) {
+                        break;
+                    }
+                }
+
+                if (m == l) {
+                    break;
+                }
+
+                if (++iterations > 60) {
+                    throw std::runtime_error("Eigenvalues operation: the tridiagonal QL iteration does not converge");
+                }
+
+                auto g = (d[l + 1] - d[l]) / (2.0 * e[l]);
+                auto r = std::hypot(g, 1.0);
+                g = d[m] - d[l] + e[l] / (g + std::copysign(r, g));
+
+                double s{ 1.0 }, c{ 1.0 }, p{ 0.0 };
+                std::ptrdiff_t i = m - 1;
+                for (; i >= l; --i) {
+                    auto f = s * e[i];
+                    auto b = c * e[i];
+                    r = std::hypot(f, g);
+                    e[i + 1] = r;
+                    if (r == 0.0) {
+                        d[i + 1] -= p;
+                        e[m] = 0.0;
+                        break;
+                    }
+
+                    s = f / r;
+                    c = g / r;
+                    g = d[i + 1] - p;
+                    r = (d[i] - g) * s + 2.0 * c * b;
+                    p = s * r;
+                    d[i + 1] = g + p;
+                    g = c * r - b;
+
+                    for (std::ptrdiff_t k = 0; k < size; ++k) {
+                        f = z[k * size + i + 1];
+                        z[k * size + i + 1] = s * z[k * size + i] + c * f;
+                        z[k * size + i] = c * z[k * size + i] - s * f;
+                    }
+                }
+
+                if (r == 0.0 && i >= l) {
+                    continue;
+                }
+
+                d[l] -= p;
+                e[l] = g;
+                e[m] = 0.0;
+            } while (true);
+        }
+    }
+
+    // Cyclic Jacobi eigen decomposition of a small dense symmetric matrix a (size x size, destroyed): the
+    // eigenvalues are returned, the eigenvectors are the columns of v.
+    inline std::vector<double> symmetric_eigen(std::vector<double>& a, std::size_t size, std::vector<double>& v) {
+        v.assign(size * size, 0.0);
+        for (std::size_t i = 0; i < size; ++i) {
+            v[i * size + i] = 1.0;
+        }
+
+        for (std::size_t sweep = 0; sweep < 100; ++sweep) {
+            double off{ 0.0 }, norm{ 0.0 };
+            for (std::size_t p = 0; p < size; ++p) {
+                for (std::size_t q = 0; q < size; ++q) {
+                    norm += a[p * size + q] * a[p * size + q];
+                    if (p != q) {
+                        off += a[p * size + q] * a[p * size + q];
+                    }
+                }
+            }
+            if (off <= std::numeric_limits<double>::epsilon() * std::numeric_limits<double>::epsilon() * norm) {
+                break;
+            }
+
+            for (std::size_t p = 0; p + 1 < size; ++p) {
+                for (auto q = p + 1; q < size; ++q) {
+                    const auto apq = a[p * size + q];
+                    if (apq == 0.0) {
+                        continue;
+                    }
+
+                    const auto theta = (a[q * size + q] - a[p * size + p]) / (2.0 * apq);
+                    const auto t = std::copysign(1.0, theta) / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+                    const auto c = 1.0 / std::sqrt(t * t + 1.0);
+                    const auto s = t * c;
+
+                    for (std::size_t k = 0; k < size; ++k) {
+                        const auto akp = a[k * size + p];
+                        const auto akq = a[k * size + q];
+                        a[k * size + p] = c * akp - s * akq;
+                        a[k * size + q] = s * akp + c * akq;
+                    }
+                    for (std::size_t k = 0; k < size; ++k) {
+                        const auto apk = a[p * size + k];
+                        const auto aqk = a[q * size + k];
+                        a[p * size + k] = c * apk - s * aqk;
+                        a[q * size + k] = s * apk + c * aqk;
+                    }
+                    for (std::size_t k = 0; k < size; ++k) {
+                        const auto vkp = v[k * size + p];
+                        const auto vkq = v[k * size + q];
+                        v[k * size + p] = c * vkp - s * vkq;
+                        v[k * size + q] = s * vkp + c * vkq;
+                    }
+                }
+            }
+        }
+
+        std::vector<double> values(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            values[i] = a[i * size + i];
+        }
+        return values;
+    }
+
+    // Lanczos iteration with full reorthogonalization for the `settings.count` eigenvalues of largest magnitude
+    // of a symmetric operator of order n. Convergence is tested on the Ritz residuals |beta_j * s_ji| relative
+    // to the Ritz values every few steps.
+    [[nodiscard]] inline eigen_result lanczos(std::size_t n, const symmetric_operator& apply, const options& settings) {
+        const auto count = std::min(settings.count, n);
+        const auto steps = std::min(std::max(settings.max_iterations, count), n);
+
+        eigen_result result;
+        if (count == 0) {
+            result.converged = true;
+            return result;
+        }
+
+        // basis vectors are stored one after another
+        std::vector<double> basis(n * steps);
+        std::vector<double> alpha, beta;
+        std::vector<double> w(n), projections(steps);
+
+        std::mt19937_64 engine(settings.seed);
+        std::normal_distribution<double> distribution;
+        std::vector<double> current(n);
+        for (auto& value : current) {
+            value = distribution(engine);
+        }
+
+        auto dot = [n](const double* x, const double* y) {
+            double sum{ 0.0 };
+            for (std::size_t i = 0; i < n; ++i) {
+                sum += x[i] * y[i];
+            }
+            return sum;
+        };
+
+        auto norm = std::sqrt(dot(current.data(), current.data()));
+        std::transform(std::begin(current), std::end(current), std::begin(basis), [norm](double value) { return value / norm; });
+
+        std::vector<double> ritz_values, ritz_vectors;
+        std::vector<std::size_t> order;
+        const std::size_t check_every = std::max<std::size_t>(count, 5);
+        double scale{ 0.0 };
+
+        for (std::size_t j = 0; j < steps; ++j) {
+            const auto* v = basis.data() + j * n;
+            current.assign(v, v + n);
+            apply(current, w);
+
+            alpha.push_back(dot(w.data(), v));
+
+            // classical Gram-Schmidt against the whole basis, twice
+            for (int pass = 0; pass < 2; ++pass) {
+                utility::parallel_for(0, j + 1, 8, [&](std::size_t first, std::size_t last) {
+                    for (auto i = first; i < last; ++i) {
+                        projections[i] = dot(w.data(), basis.data() + i * n);
+                    }
+                });
+                utility::parallel_for(0, n, 4096, [&](std::size_t first, std::size_t last) {
+                    for (std::size_t i = 0; i <= j; ++i) {
+                        const auto* vector = basis.data() + i * n;
+                        for (auto index = first; index < last; ++index) {
+                            w[index] -= projections[i] * vector[index];
+                        }
+                    }
+                });
+            }
+
+            const auto next_beta = std::sqrt(dot(w.data(), w.data()));
+            scale = std::max({ scale, std::abs(alpha.back()), next_beta });
+            // an invariant subspace was found, its Ritz values are exact
+            const bool breakdown = next_beta <= std::numeric_limits<double>::epsilon() * scale;
+            const bool exhausted = breakdown || j + 1 == steps;
+
+            if (exhausted || (j + 1 >= count && (j + 1) % check_every == 0)) {
+                ritz_values = alpha;
+                tridiagonal_eigen(ritz_values, beta, ritz_vectors);
+
+                order.resize(ritz_values.size());
+                std::iota(std::begin(order), std::end(order), 0);
+                std::sort(std::begin(order), std::end(order), [&](std::size_t left, std::size_t right) {
+                    return std::abs(ritz_values[left]) > std::abs(ritz_values[right]);
+                });
+
+                bool converged{ true };
+                const auto size = ritz_values.size();
+                for (std::size_t index = 0; index < std::min(count, size); ++index) {
+                    auto column = order[index];
+                    auto residual = next_beta * std::abs(ritz_vectors[(size - 1) * size + column]);
+                    converged = converged && residual <= settings.tolerance * std::max(std::abs(ritz_values[column]), std::numeric_limits<double>::min());
+                }
+
+                result.iterations = j + 1;
+                result.converged = converged || breakdown;
+                if (result.converged || exhausted) {
+                    break;
+                }
+            }
+
+            if (exhausted) {
+                break;
+            }
+
+            beta.push_back(next_beta);
+            std::transform(std::begin(w), std::end(w), basis.data() + (j + 1) * n, [next_beta](double value) { return value / next_beta; });
+        }
+
+        // Ritz vectors: basis * s. A Krylov space smaller than `count` yields fewer pairs.
+        const auto size = ritz_values.size();
+        const auto found = std::min(count, size);
+        result.values.resize(found);
+        result.vectors = matrix_d<double>(static_cast<std::uint32_t>(n), static_cast<std::uint32_t>(found));
+        for (std::size_t index = 0; index < found; ++index) {
+            auto column = order[index];
+            result.values[index] = ritz_values[column];
+        }
+
+        auto* vectors = result.vectors.begin();
+        utility::parallel_for(0, n, 256, [&](std::size_t first, std::size_t last) {
+            for (auto row = first; row < last; ++row) {
+                for (std::size_t index = 0; index < found; ++index) {
+                    auto column = order[index];
+                    double sum{ 0.0 };
+                    for (std::size_t i = 0; i < size; ++i) {
+                        sum += basis[i * n + row] * ritz_vectors[i * size + column];
+                    }
+                    vectors[row * found + index] = sum;
+                }
+            }
+        });
+
+        return result;
+    }
+
+    // Dominant eigenpairs of a symmetric matrix, the products run through the parallel gemv.
+    [[nodiscard]] inline eigen_result eigenvalues(const matrix_d<double>& matrix, const options& settings = {}) {
+        const auto n = matrix.get_rows_count();
+        if (n != matrix.get_columns_count()) {
+            throw std::runtime_error("The matrix is not square");
+        }
+
+        for (std::uint32_t ri = 0; ri < n; ++ri) {
+            for (std::uint32_t ci = ri + 1; ci < n; ++ci) {
+                auto scale = std::max({ std::abs(matrix(ri, ci)), std::abs(matrix(ci, ri)), 1.0 });
+                if (std::abs(matrix(ri, ci) - matrix(ci, ri)) > 1e-12 * scale) {
+                    throw std::runtime_error("Eigenvalues operation: the matrix is not symmetric");
+                }
+            }
+        }
+
+        return lanczos(n, [&matrix](const std::vector<double>& x, std::vector<double>& y) {
+            matrix.gemv(1.0, utility::Transposition::None, x, 0.0, y);
+        }, settings);
+    }
+
+    // Orthonormal basis of the columns of a (rows >= columns)
+    [[nodiscard]] inline matrix_d<double> orthonormalize(const matrix_d<double>& a) {
+        return a.qr().first;
+    }
+
+    // Randomized SVD (Halko, Martinsson, Tropp): a Gaussian sketch of the range refined by power iterations
+    // until the leading singular values change by less than the tolerance, then an exact SVD of the small
+    // projected matrix.
+    [[nodiscard]] inline svd_result svd(const matrix_d<double>& matrix, const options& settings = {}) {
+        using utility::Transposition;
+
+        const std::size_t m = matrix.get_rows_count();
+        const std::size_t n = matrix.get_columns_count();
+        const auto count = std::min({ settings.count, m, n });
+        const auto width = std::min({ count + settings.oversampling, m, n });
+
+        svd_result result;
+        if (count == 0) {
+            result.converged = true;
+            return result;
+        }
+
+        std::mt19937_64 engine(settings.seed);
+        std::normal_distribution<double> distribution;
+        matrix_d<double> sketch(static_cast<std::uint32_t>(n), static_cast<std::uint32_t>(width));
+        std::generate(sketch.begin(), sketch.end(), [&]() { return distribution(engine); });
+
+        matrix_d<double> range(static_cast<std::uint32_t>(m), static_cast<std::uint32_t>(width));
+        range.gemm(1.0, matrix, Transposition::None, sketch, Transposition::None, 0.0);
+
+        matrix_d<double> q, projected(static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(n));
+        std::vector<double> gram, small_vectors, values, previous;
+
+        for (std::size_t iteration = 0;; ++iteration) {
+            q = orthonormalize(range);
+
+            // B = Q^T A, singular values of B from the eigenvalues of B B^T
+            projected.gemm(1.0, q, Transposition::Transpose, matrix, Transposition::None, 0.0);
+            matrix_d<double> product(static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(width));
+            product.gemm(1.0, projected, Transposition::None, projected, Transposition::Transpose, 0.0);
+
+            gram.assign(std::as_const(product).begin(), std::as_const(product).end());
+            values = symmetric_eigen(gram, width, small_vectors);
+
+            std::vector<double> leading(values);
+            std::sort(std::begin(leading), std::end(leading), std::greater<>{});
+            leading.resize(count);
+
+            bool converged = !previous.empty();
+            for (std::size_t index = 0; index < previous.size() && converged; ++index) {
+                auto current = std::sqrt(std::max(leading[index], 0.0));
+                auto before = std::sqrt(std::max(previous[index], 0.0));
+                converged = std::abs(current - before) <= settings.tolerance * std::max(current, std::numeric_limits<double>::min());
+            }
+
+            result.iterations = iteration;
+            result.converged = converged;
+            if (converged || iteration >= settings.max_iterations) {
+                break;
+            }
+            previous = std::move(leading);
+
+            // power iteration with reorthonormalization: range = A orth(A^T Q)
+            matrix_d<double> back(static_cast<std::uint32_t>(n), static_cast<std::uint32_t>(width));
+            back.gemm(1.0, matrix, Transposition::Transpose, q, Transposition::None, 0.0);
+            auto back_basis = orthonormalize(back);
+            range.gemm(1.0, matrix, Transposition::None, back_basis, Transposition::None, 0.0);
+        }
+
+        std::vector<std::size_t> order(width);
+        std::iota(std::begin(order), std::end(order), 0);
+        std::sort(std::begin(order), std::end(order), [&](std::size_t left, std::size_t right) { return values[left] > values[right]; });
+
+        // U = Q U_b, V = B^T U_b / sigma
+        matrix_d<double> small_left(static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(count));
+        result.values.resize(count);
+        for (std::size_t index = 0; index < count; ++index) {
+            result.values[index] = std::sqrt(std::max(values[order[index]], 0.0));
+            for (std::uint32_t ri = 0; ri < width; ++ri) {
+                small_left(ri, static_cast<std::uint32_t>(index)) = small_vectors[ri * width + order[index]];
+            }
+        }
+
+        result.left = matrix_d<double>(static_cast<std::uint32_t>(m), static_cast<std::uint32_t>(count));
+        result.left.gemm(1.0, q, Transposition::None, small_left, Transposition::None, 0.0);
+
+        result.right = matrix_d<double>(static_cast<std::uint32_t>(n), static_cast<std::uint32_t>(count));
+        result.right.gemm(1.0, projected, Transposition::Transpose, small_left, Transposition::None, 0.0);
+        for (std::uint32_t ci = 0; ci < count; ++ci) {
+            for (auto& value : result.right.column_range(ci)) {
+                value = result.values[ci] > 0.0 ? value / result.values[ci] : 0.0;
+            }
+        }
+
+        return result;
+    }
+}
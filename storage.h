@@ -0,0 +1,122 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace matrices::memory {
+    // Reference counted copy-on-write element buffer. Copies share the elements in O(1) and const access is safe
+    // from any number of concurrent readers. Every mutable accessor detaches first: a shared buffer makes its own
+    // deep copy, a unique one only loads the reference count. Kernels take their mutable pointer once, before any
+    // worker thread starts, so the check is made once per operation and never raced by the workers.
+    // Pointers and references from the mutable accessors are invalidated by a copy of the buffer: they still point
+    // at the elements the copy now shares, so writes through them would show up in the copy.
+    template<typename T, typename Allocator>
+    class shared_buffer final {
+        using vector_type = std::vector<T, Allocator>;
+
+        std::shared_ptr<vector_type> buffer{};
+
+        vector_type& unique() {
+            detach();
+            return *buffer;
+        }
+    public:
+        using value_type = T;
+        using iterator = T*;
+        using const_iterator = const T*;
+
+        shared_buffer() = default;
+        shared_buffer(const shared_buffer&) = default;
+        shared_buffer(shared_buffer&&) noexcept = default;
+        shared_buffer& operator=(const shared_buffer&) = default;
+        shared_buffer& operator=(shared_buffer&&) noexcept = default;
+        ~shared_buffer() = default;
+
+        // Gives the buffer its own elements. The acquire fence pairs with the release of the last other owner,
+        // so its reads of the elements happen before they are written here.
+        void detach() {
+            if (!buffer) {
+                buffer = std::allocate_shared<vector_type>(Allocator{});
+            }
+            else if (buffer.use_count() > 1) {
+                buffer = std::allocate_shared<vector_type>(Allocator{}, *buffer);
+            }
+            else {
+                std::atomic_thread_fence(std::memory_order_acquire);
+            }
+        }
+
+        [[nodiscard]] bool is_shared() const {
+            return buffer && buffer.use_count() > 1;
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return buffer ? buffer->size() : 0;
+        }
+
+        void resize(std::size_t count) {
+            unique().resize(count);
+        }
+
+        [[nodiscard]] const T* data() const {
+            return buffer ? buffer->data() : nullptr;
+        }
+
+        [[nodiscard]] T* data() {
+            return unique().data();
+        }
+
+        [[nodiscard]] const T& operator[](std::size_t index) const {
+            return (*buffer)[index];
+        }
+
+        [[nodiscard]] T& operator[](std::size_t index) {
+            return unique()[index];
+        }
+
+        [[nodiscard]] const T& at(std::size_t index) const {
+            if (index >= size()) {
+                throw std::out_of_range("Invalid element index");
+            }
+            return (*buffer)[index];
+        }
+
+        [[nodiscard]] T& at(std::size_t index) {
+            if (index >= size()) {
+                throw std::out_of_range("Invalid element index");
+            }
+            return unique()[index];
+        }
+
+        [[nodiscard]] const_iterator begin() const {
+            return data();
+        }
+
+        [[nodiscard]] const_iterator end() const {
+            return data() + size();
+        }
+
+        [[nodiscard]] iterator begin() {
+            return data();
+        }
+
+        [[nodiscard]] iterator end() {
+            return data() + size();
+        }
+    };
+}
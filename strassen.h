@@ -0,0 +1,197 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "parallel.h"
+
+// Strassen-Winograd multiplication of square row-major blocks (7 products and 15 additions per level).
+namespace matrices::strassen {
+    // Bump allocator over one buffer sized up front (taken from the operation's memory::arena_scope), so the
+    // whole recursion allocates at most once. Parallel branches get arenas over disjoint slices of their parent.
+    template<typename T>
+    class workspace_arena final {
+        T* base{ nullptr };
+        std::size_t capacity{ 0 };
+        std::size_t used{ 0 };
+    public:
+        workspace_arena(T* slice, std::size_t size) : base(slice), capacity(size) {
+        }
+
+        [[nodiscard]] T* take(std::size_t count) {
+            if (used + count > capacity) {
+                throw std::runtime_error("Strassen multiplication: workspace exhausted");
+            }
+            auto* result = base + used;
+            used += count;
+            return result;
+        }
+
+        [[nodiscard]] std::size_t mark() const {
+            return used;
+        }
+
+        void release(std::size_t position) {
+            used = position;
+        }
+    };
+
+    // Workspace for the recursion on an n x n block: 8 operand sums and 7 products of size (n/2)^2 per level,
+    // each of the top `parallel_levels` levels also holds the workspace of its seven concurrent sub-products.
+    [[nodiscard]] inline std::size_t workspace_size(std::size_t n, std::size_t crossover, std::size_t parallel_levels = 0) {
+        if (n <= crossover || n % 2 != 0) {
+            return 0;
+        }
+
+        auto h = n / 2;
+        auto nested = workspace_size(h, crossover, parallel_levels > 0 ? parallel_levels - 1 : 0);
+        return 15 * h * h + (parallel_levels > 0 ? 7 * nested : nested);
+    }
+
+    // Splits n into base * 2^levels with base <= crossover, the padded size is the smallest such product >= n.
+    [[nodiscard]] inline std::size_t padded_size(std::size_t n, std::size_t crossover) {
+        crossover = std::max<std::size_t>(crossover, 1);
+
+        std::size_t levels{ 0 };
+        auto base = n;
+        while (base > crossover) {
+            base = (base + 1) / 2;
+            ++levels;
+        }
+        return base << levels;
+    }
+
+    template<typename T>
+    void add(std::size_t n, const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc) {
+        for (std::size_t ri = 0; ri < n; ++ri) {
+            for (std::size_t ci = 0; ci < n; ++ci) {
+                c[ri * ldc + ci] = a[ri * lda + ci] + b[ri * ldb + ci];
+            }
+        }
+    }
+
+    template<typename T>
+    void subtract(std::size_t n, const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc) {
+        for (std::size_t ri = 0; ri < n; ++ri) {
+            for (std::size_t ci = 0; ci < n; ++ci) {
+                c[ri * ldc + ci] = a[ri * lda + ci] - b[ri * ldb + ci];
+            }
+        }
+    }
+
+    // c = a * b for n x n blocks. base_multiply(n, a, lda, b, ldb, c, ldc) computes c = a * b below the crossover.
+    // With parallel_levels > 0 the seven products of the top levels run concurrently on separate arena slices.
+    template<typename T, typename BaseMultiply>
+    void multiply(std::size_t n, const T* a, std::size_t lda, const T* b, std::size_t ldb, T* c, std::size_t ldc,
+        std::size_t crossover, std::size_t parallel_levels, workspace_arena<T>& arena, const BaseMultiply& base_multiply) {
+        if (n <= crossover || n % 2 != 0) {
+            base_multiply(n, a, lda, b, ldb, c, ldc);
+            return;
+        }
+
+        const auto h = n / 2;
+        const auto quarter = h * h;
+        const auto mark = arena.mark();
+
+        const T* a11 = a;
+        const T* a12 = a + h;
+        const T* a21 = a + h * lda;
+        const T* a22 = a21 + h;
+        const T* b11 = b;
+        const T* b12 = b + h;
+        const T* b21 = b + h * ldb;
+        const T* b22 = b21 + h;
+
+        std::array<T*, 4> s{}, t{};
+        std::array<T*, 7> p{};
+        for (auto& block : s) block = arena.take(quarter);
+        for (auto& block : t) block = arena.take(quarter);
+        for (auto& block : p) block = arena.take(quarter);
+
+        subtract(h, b12, ldb, b11, ldb, t[0], h);       // T1 = B12 - B11
+        add(h, a21, lda, a22, lda, s[0], h);            // S1 = A21 + A22
+        subtract(h, s[0], h, a11, lda, s[1], h);        // S2 = S1 - A11
+        subtract(h, a11, lda, a21, lda, s[2], h);       // S3 = A11 - A21
+        subtract(h, a12, lda, s[1], h, s[3], h);        // S4 = A12 - S2
+        subtract(h, b22, ldb, t[0], h, t[1], h);        // T2 = B22 - T1
+        subtract(h, b22, ldb, b12, ldb, t[2], h);       // T3 = B22 - B12
+        subtract(h, t[1], h, b21, ldb, t[3], h);        // T4 = T2 - B21
+
+        struct product {
+            const T* left;
+            std::size_t left_stride;
+            const T* right;
+            std::size_t right_stride;
+        };
+
+        const std::array<product, 7> products{ {
+            { a11, lda, b11, ldb },     // P1 = A11 * B11
+            { a12, lda, b21, ldb },     // P2 = A12 * B21
+            { s[3], h, b22, ldb },      // P3 = S4 * B22
+            { a22, lda, t[3], h },      // P4 = A22 * T4
+            { s[0], h, t[0], h },       // P5 = S1 * T1
+            { s[1], h, t[1], h },       // P6 = S2 * T2
+            { s[2], h, t[2], h } } };   // P7 = S3 * T3
+
+        if (parallel_levels > 0) {
+            const auto slice = workspace_size(h, crossover, parallel_levels - 1);
+
+            std::vector<workspace_arena<T>> slices;
+            slices.reserve(products.size());
+            for (std::size_t index = 0; index < products.size(); ++index) {
+                slices.emplace_back(arena.take(slice), slice);
+            }
+
+            utility::parallel_for(0, products.size(), 1, [&](std::size_t first, std::size_t last) {
+                for (auto index = first; index < last; ++index) {
+                    const auto& item = products[index];
+                    multiply(h, item.left, item.left_stride, item.right, item.right_stride, p[index], h,
+                        crossover, parallel_levels - 1, slices[index], base_multiply);
+                }
+            });
+        }
+        else {
+            for (std::size_t index = 0; index < products.size(); ++index) {
+                const auto& item = products[index];
+                multiply(h, item.left, item.left_stride, item.right, item.right_stride, p[index], h,
+                    crossover, 0, arena, base_multiply);
+            }
+        }
+
+        T* c11 = c;
+        T* c12 = c + h;
+        T* c21 = c + h * ldc;
+        T* c22 = c21 + h;
+
+        for (std::size_t ri = 0; ri < h; ++ri) {
+            for (std::size_t ci = 0; ci < h; ++ci) {
+                auto index = ri * h + ci;
+                auto u2 = p[0][index] + p[5][index];    // U2 = P1 + P6
+                auto u3 = u2 + p[6][index];             // U3 = U2 + P7
+                auto u4 = u2 + p[4][index];             // U4 = U2 + P5
+
+                c11[ri * ldc + ci] = p[0][index] + p[1][index];     // U1 = P1 + P2
+                c12[ri * ldc + ci] = u4 + p[2][index];              // U5 = U4 + P3
+                c21[ri * ldc + ci] = u3 - p[3][index];              // U6 = U3 - P4
+                c22[ri * ldc + ci] = u3 + p[4][index];              // U7 = U3 + P5
+            }
+        }
+
+        arena.release(mark);
+    }
+}
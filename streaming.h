@@ -0,0 +1,202 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <format>
+#include <memory>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "serializer.h"
+
+// One operator matrix applied to a stream of vectors: the vectors are grouped into blocks and every block is
+// multiplied with one gemm instead of a gemv per vector.
+namespace matrices::streaming {
+    struct options {
+        // vectors multiplied together
+        std::uint32_t batch_size{ 256 };
+        // longest wait of a vector for its block to fill up, an incomplete block is multiplied after it
+        std::chrono::milliseconds max_latency{ 100 };
+        char delim{ ',' };
+    };
+
+    struct statistics {
+        std::size_t vectors{ 0 };
+        std::size_t batches{ 0 };
+    };
+
+    // Reads the vectors from `input`, one CSV line each (empty lines are skipped), and writes matrix * vector
+    // for every one of them to `output` as a CSV line, in the input order. The output is flushed after every
+    // block. Reading and parsing run on a separate thread that stays at most a few blocks ahead. When the
+    // products fail, the error is thrown at once: a reader still blocked in `input` (a terminal or a pipe that
+    // has not been closed) is detached, so `input` must outlive it, as std::cin does.
+    inline statistics apply(const matrix_d<double>& matrix, std::istream& input, std::ostream& output, const options& settings = {}) {
+        using clock = std::chrono::steady_clock;
+
+        struct pending {
+            clock::time_point arrival;
+            std::vector<double> values;
+        };
+
+        // owned together with the reader, which may outlive this call
+        struct shared_state {
+            std::mutex mutex;
+            std::condition_variable ready;
+            std::condition_variable space;
+            std::deque<pending> queue;
+            bool finished{ false };
+            bool stopping{ false };
+            std::exception_ptr error{ nullptr };
+        };
+
+        // time a failed apply gives the reader to notice the stop before it is detached
+        constexpr std::chrono::milliseconds reader_grace{ 100 };
+
+        const auto columns = matrix.get_columns_count();
+        const auto batch = std::max<std::uint32_t>(settings.batch_size, 1);
+        const std::size_t queue_limit = std::size_t{ 4 } * batch;
+        auto state = std::make_shared<shared_state>();
+
+        std::thread reader([state, &input, columns, queue_limit, delim = settings.delim]() {
+            try {
+                std::size_t line_number{ 0 };
+                for (std::string line; std::getline(input, line);) {
+                    ++line_number;
+                    if (line.empty() || line == "\r") {
+                        continue;
+                    }
+
+                    std::vector<double> values(columns, 0.0);
+                    auto count = serialize::parse_csv_line(line, [&](std::uint32_t column, double value) {
+                        if (column < columns) {
+                            values[column] = value;
+                        }
+                    }, delim);
+                    if (count != columns) {
+                        throw std::runtime_error(std::format("Apply operation: the vector on line {} has {} value(s), the matrix has {} column(s)",
+                            line_number, count, columns));
+                    }
+
+                    std::unique_lock lock(state->mutex);
+                    state->space.wait(lock, [&]() { return state->queue.size() < queue_limit || state->stopping; });
+                    if (state->stopping) {
+                        break;
+                    }
+                    state->queue.push_back({ clock::now(), std::move(values) });
+                    lock.unlock();
+                    state->ready.notify_one();
+                }
+            }
+            catch (...) {
+                std::lock_guard lock(state->mutex);
+                state->error = std::current_exception();
+            }
+
+            {
+                std::lock_guard lock(state->mutex);
+                state->finished = true;
+            }
+            state->ready.notify_one();
+        });
+
+        auto stop_reader = [&](bool failed) {
+            std::unique_lock lock(state->mutex);
+            state->stopping = true;
+            state->space.notify_one();
+
+            if (failed && !state->ready.wait_for(lock, reader_grace, [&]() { return state->finished; })) {
+                reader.detach();
+                return;
+            }
+            lock.unlock();
+            reader.join();
+        };
+
+        statistics result;
+        try {
+            std::vector<pending> block;
+            for (;;) {
+                block.clear();
+                {
+                    std::unique_lock lock(state->mutex);
+                    for (;;) {
+                        if (state->error) {
+                            std::rethrow_exception(state->error);
+                        }
+                        if (state->queue.size() >= batch || state->finished) {
+                            break;
+                        }
+                        if (state->queue.empty()) {
+                            state->ready.wait(lock);
+                        }
+                        else if (state->ready.wait_until(lock, state->queue.front().arrival + settings.max_latency) == std::cv_status::timeout) {
+                            break;
+                        }
+                    }
+
+                    auto count = std::min<std::size_t>(state->queue.size(), batch);
+                    std::move(std::begin(state->queue), std::begin(state->queue) + count, std::back_inserter(block));
+                    state->queue.erase(std::begin(state->queue), std::begin(state->queue) + count);
+                }
+                state->space.notify_one();
+
+                if (block.empty()) {
+                    break;
+                }
+
+                const auto count = static_cast<std::uint32_t>(block.size());
+                matrix_d<double> vectors(count, columns);
+                for (std::uint32_t index = 0; index < count; ++index) {
+                    std::copy(std::begin(block[index].values), std::end(block[index].values), std::begin(vectors.row_span(index)));
+                }
+
+                // the products of the block are the rows of vectors * matrix^T
+                matrix_d<double> products(count, matrix.get_rows_count());
+                {
+                    MATRICES_PROFILE_SCOPE("compute", "phase");
+                    products.gemm(1.0, vectors, utility::Transposition::None, matrix, utility::Transposition::Transpose, 0.0);
+                }
+                {
+                    MATRICES_PROFILE_SCOPE("write", "phase");
+                    serialize::write_csv_rows(output, std::as_const(products), 0, count, settings.delim);
+                    output.flush();
+                }
+                if (!output) {
+                    throw std::runtime_error("Apply operation: unable to write the results");
+                }
+
+                result.vectors += count;
+                ++result.batches;
+            }
+        }
+        catch (...) {
+            stop_reader(true);
+            throw;
+        }
+
+        stop_reader(false);
+        return result;
+    }
+}
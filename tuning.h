@@ -0,0 +1,163 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+
+// Machine dependent knobs of the kernels: tile sizes, the sizes from which work is split between threads and
+// the algorithm crossovers. The values are read once from the tuning profile written by the autotune command
+// (MATRICES_TUNING_PROFILE, otherwise ~/.matrices_tuning), the defaults below are used without one.
+namespace matrices::tuning {
+    struct parameters {
+        // worker threads of the parallel loops, zero for every hardware thread
+        std::size_t threads{ 0 };
+
+        // matrix_d gemm: depth of a packed panel, rows per parallel task and the multiply-adds from which the
+        // rows are split between threads
+        std::size_t gemm_depth_block{ 256 };
+        std::size_t gemm_row_grain{ 16 };
+        std::size_t parallel_gemm_threshold{ std::size_t{ 1 } << 18 };
+        // Strassen recursion stops at this size
+        std::size_t strassen_crossover{ 256 };
+        // smallest dimension routed to the external BLAS/LAPACK backend
+        std::size_t backend_threshold{ 128 };
+
+        std::size_t transpose_block{ 64 };
+        std::size_t parallel_transpose_threshold{ std::size_t{ 1 } << 16 };
+
+        // elements or multiply-adds from which the other kernels go parallel
+        std::size_t factorization_parallel_threshold{ std::size_t{ 1 } << 18 };
+        std::size_t elementwise_parallel_threshold{ std::size_t{ 1 } << 16 };
+        std::size_t reduction_parallel_threshold{ std::size_t{ 1 } << 16 };
+        // matrix_f::multiply_with_threads stays on the calling thread below this many multiply-adds
+        std::size_t fixed_parallel_threshold{ std::size_t{ 1 } << 15 };
+    };
+
+    struct field {
+        const char* name;
+        std::size_t parameters::* value;
+    };
+
+    inline constexpr std::array<field, 12> fields{ {
+        { "threads", &parameters::threads },
+        { "gemm_depth_block", &parameters::gemm_depth_block },
+        { "gemm_row_grain", &parameters::gemm_row_grain },
+        { "parallel_gemm_threshold", &parameters::parallel_gemm_threshold },
+        { "strassen_crossover", &parameters::strassen_crossover },
+        { "backend_threshold", &parameters::backend_threshold },
+        { "transpose_block", &parameters::transpose_block },
+        { "parallel_transpose_threshold", &parameters::parallel_transpose_threshold },
+        { "factorization_parallel_threshold", &parameters::factorization_parallel_threshold },
+        { "elementwise_parallel_threshold", &parameters::elementwise_parallel_threshold },
+        { "reduction_parallel_threshold", &parameters::reduction_parallel_threshold },
+        { "fixed_parallel_threshold", &parameters::fixed_parallel_threshold } } };
+
+    [[nodiscard]] inline std::filesystem::path default_path() {
+        if (const char* value = std::getenv("MATRICES_TUNING_PROFILE"); value != nullptr && *value != '\0') {
+            return value;
+        }
+        if (const char* home = std::getenv("HOME"); home != nullptr && *home != '\0') {
+            return std::filesystem::path(home) / ".matrices_tuning";
+        }
+        return ".matrices_tuning";
+    }
+
+    // "name = value" lines, '#' starts a comment. Unknown names are skipped so that older builds can read newer
+    // profiles, missing ones keep their defaults.
+    [[nodiscard]] inline parameters load(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file for reading");
+        }
+
+        parameters result;
+        for (std::string line; std::getline(file, line);) {
+            line = line.substr(0, line.find('#'));
+
+            auto separator = line.find('=');
+            if (separator == std::string::npos) {
+                continue;
+            }
+
+            auto trim = [](std::string text) {
+                auto first = text.find_first_not_of(" \t\r");
+                auto last = text.find_last_not_of(" \t\r");
+                return first == std::string::npos ? std::string{} : text.substr(first, last - first + 1);
+            };
+            auto name = trim(line.substr(0, separator));
+            auto value = trim(line.substr(separator + 1));
+
+            for (const auto& item : fields) {
+                if (name != item.name) {
+                    continue;
+                }
+
+                try {
+                    std::size_t parsed{ 0 };
+                    result.*item.value = std::stoull(value, &parsed);
+                    if (parsed != value.size()) {
+                        throw std::invalid_argument(value);
+                    }
+                }
+                catch (std::exception&) {
+                    throw std::runtime_error("Tuning profile: invalid value of " + name);
+                }
+            }
+        }
+
+        // a zero block would never advance
+        for (auto* value : { &result.gemm_depth_block, &result.gemm_row_grain, &result.strassen_crossover, &result.transpose_block }) {
+            *value = std::max<std::size_t>(*value, 1);
+        }
+        return result;
+    }
+
+    inline void save(const std::filesystem::path& path, const parameters& values) {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Unable to open file for writting");
+        }
+
+        file << "# matrices tuning profile, written by the autotune command\n";
+        for (const auto& item : fields) {
+            file << item.name << " = " << values.*item.value << "\n";
+        }
+    }
+
+    // Loaded from default_path() on first use, a missing or unreadable profile leaves the defaults.
+    [[nodiscard]] inline parameters& current() {
+        static parameters instance = []() {
+            auto path = default_path();
+            std::error_code error;
+            if (!std::filesystem::exists(path, error)) {
+                return parameters{};
+            }
+
+            try {
+                return load(path);
+            }
+            catch (std::exception&) {
+                return parameters{};
+            }
+        }();
+        return instance;
+    }
+}
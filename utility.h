@@ -16,6 +16,20 @@ namespace utility {
     template<typename T>
     concept Scalar = std::is_arithmetic_v<T>;
 
+    // Operand flag of the BLAS-style gemm/gemv entry points.
+    enum class Transposition : short {
+        None,
+        Transpose
+    };
+
+    // Per row or per column reduction of the matrix classes.
+    enum class Reduction : short {
+        Sum,
+        Norm,
+        Min,
+        Max
+    };
+
     template<typename T>
     concept is_matrix = requires (T & value) {
         typename T::internal_type;
@@ -0,0 +1,174 @@
+/****************************************************************************************
+* Copyright  2023 Dmitry Kuznetsov.                                                    *
+*                                                                                       *
+* All rights reserved. No part of this software may be reproduced, distributed,         *
+* or transmitted in any form or by any means, including photocopying, recording,        *
+* or other electronic or mechanical methods, without the prior written permissin        *
+* of the copyright owner.                                                               *
+* Any unauthorized use, reproduction, or distribution of this software is strictly      *
+* prohibited and may # result in severe civil and criminal penalties.                   *
+*                                                                                       *
+****************************************************************************************/
+
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+// Debug builds check every element access and throw std::out_of_range on a bad index, release builds only
+// check in at(). MATRICES_CHECKED_ACCESS turns the checks on in any build.
+#if !defined(NDEBUG) && !defined(MATRICES_CHECKED_ACCESS)
+#define MATRICES_CHECKED_ACCESS
+#endif
+
+namespace matrices {
+#ifdef MATRICES_CHECKED_ACCESS
+    inline constexpr bool checked_access = true;
+#else
+    inline constexpr bool checked_access = false;
+#endif
+
+    inline void check_index(bool valid) {
+        if (!valid) {
+            throw std::out_of_range("Invalid row or column index");
+        }
+    }
+
+    // Random access iterator over elements a fixed distance apart, e.g. a column of a row major matrix. It keeps
+    // an index rather than a pointer, so the end of a column never points past the matrix buffer.
+    template<typename T>
+    class strided_iterator {
+        T* first{ nullptr };
+        std::ptrdiff_t index{ 0 };
+        std::ptrdiff_t stride{ 1 };
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using iterator_concept = std::random_access_iterator_tag;
+        using value_type = std::remove_cv_t<T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        strided_iterator() = default;
+
+        strided_iterator(T* first, std::ptrdiff_t index, std::ptrdiff_t stride) : first(first), index(index), stride(stride) {
+        }
+
+        [[nodiscard]] reference operator*() const {
+            return first[index * stride];
+        }
+
+        [[nodiscard]] pointer operator->() const {
+            return first + index * stride;
+        }
+
+        [[nodiscard]] reference operator[](difference_type offset) const {
+            return first[(index + offset) * stride];
+        }
+
+        strided_iterator& operator++() {
+            ++index;
+            return *this;
+        }
+
+        strided_iterator operator++(int) {
+            auto result = *this;
+            ++index;
+            return result;
+        }
+
+        strided_iterator& operator--() {
+            --index;
+            return *this;
+        }
+
+        strided_iterator operator--(int) {
+            auto result = *this;
+            --index;
+            return result;
+        }
+
+        strided_iterator& operator+=(difference_type offset) {
+            index += offset;
+            return *this;
+        }
+
+        strided_iterator& operator-=(difference_type offset) {
+            index -= offset;
+            return *this;
+        }
+
+        [[nodiscard]] friend strided_iterator operator+(strided_iterator iterator, difference_type offset) {
+            return iterator += offset;
+        }
+
+        [[nodiscard]] friend strided_iterator operator+(difference_type offset, strided_iterator iterator) {
+            return iterator += offset;
+        }
+
+        [[nodiscard]] friend strided_iterator operator-(strided_iterator iterator, difference_type offset) {
+            return iterator -= offset;
+        }
+
+        [[nodiscard]] friend difference_type operator-(const strided_iterator& left, const strided_iterator& right) {
+            return left.index - right.index;
+        }
+
+        [[nodiscard]] friend bool operator==(const strided_iterator& left, const strided_iterator& right) {
+            return left.index == right.index;
+        }
+
+        [[nodiscard]] friend auto operator<=>(const strided_iterator& left, const strided_iterator& right) {
+            return left.index <=> right.index;
+        }
+    };
+
+    // Non owning view of `count` elements `stride` apart. Like std::span it does not keep the matrix alive
+    // and is invalidated when the matrix is resized, or copied while the view writes to it.
+    template<typename T>
+    class strided_span {
+        T* first{ nullptr };
+        std::size_t count{ 0 };
+        std::ptrdiff_t step{ 1 };
+    public:
+        using element_type = T;
+        using value_type = std::remove_cv_t<T>;
+        using size_type = std::size_t;
+        using iterator = strided_iterator<T>;
+
+        strided_span() = default;
+
+        strided_span(T* first, std::size_t count, std::ptrdiff_t stride) : first(first), count(count), step(stride) {
+        }
+
+        [[nodiscard]] iterator begin() const {
+            return { first, 0, step };
+        }
+
+        [[nodiscard]] iterator end() const {
+            return { first, static_cast<std::ptrdiff_t>(count), step };
+        }
+
+        [[nodiscard]] T& operator[](std::size_t index) const {
+            if constexpr (checked_access) {
+                check_index(index < count);
+            }
+            return first[static_cast<std::ptrdiff_t>(index) * step];
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            return count;
+        }
+
+        [[nodiscard]] bool empty() const {
+            return count == 0;
+        }
+
+        [[nodiscard]] std::ptrdiff_t stride() const {
+            return step;
+        }
+    };
+}